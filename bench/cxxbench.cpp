@@ -0,0 +1,64 @@
+/*
+ * cxxbench :: the C++ side of exhbench
+ *
+ * The same workloads as the exhandler benchmarks, with C++ try/throw,
+ * called from exhbench.c through the functions below.
+ */
+
+extern "C" {
+long cxxbench_try(long n);
+long cxxbench_throw(long n, long depth);
+long cxxbench_unwind(long n, long depth);
+}
+
+struct Error{
+    int code;
+};
+
+struct Guard{
+    volatile long *sink;
+    ~Guard(){ (*sink)++; }
+};
+
+static volatile long sink;
+
+// -----------------------------------------------------------------
+// descend() :: recurse 'depth' frames, then throw
+// -----------------------------------------------------------------
+static __attribute__((noinline)) long descend(long depth){
+    if(depth <= 1){ throw Error{1}; }
+    return descend(depth - 1) + 1;
+}
+
+// -----------------------------------------------------------------
+// unwind() :: recurse 'depth' frames with a destructor each, then throw
+// -----------------------------------------------------------------
+static __attribute__((noinline)) void unwind(long depth){
+    Guard guard{&sink};
+    if(depth == 0){ throw Error{1}; }
+    unwind(depth - 1);
+}
+
+// -- 01
+long cxxbench_try(long n){
+    for(long i=0; i < n; i++){
+        try{ sink++; }catch(Error&){ sink--; }
+    }
+    return sink;
+}
+
+// -- 02
+long cxxbench_throw(long n, long depth){
+    for(long i=0; i < n; i++){
+        try{ sink += descend(depth); }catch(Error&){ sink++; }
+    }
+    return sink;
+}
+
+// -- 03
+long cxxbench_unwind(long n, long depth){
+    for(long i=0; i < n; i++){
+        try{ unwind(depth); }catch(Error&){ sink++; }
+    }
+    return sink;
+}
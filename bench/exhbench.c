@@ -0,0 +1,534 @@
+#define _GNU_SOURCE
+#include<stdio.h>
+#include<stddef.h>
+#include<stdlib.h>
+#include<string.h>
+#include<time.h>
+#ifdef EXHANDLER_USE_PTHREAD
+#include<pthread.h>
+#endif
+#include "../src/exhandler.h"
+
+/*
+ * exhbench :: cost of the exception runtime primitives
+ *
+ *      exhbench [-n iterations] [filter]
+ *
+ * Each case prints its time and heap allocations per operation. Only the
+ * cases whose name contains 'filter' are run. The throw cases are paired
+ * with the same workload written with error codes and with C++ throw.
+ */
+
+long cxxbench_try(long n);
+long cxxbench_throw(long n, long depth);
+long cxxbench_unwind(long n, long depth);
+
+typedef void (*bench_fn)(long n, long arg);
+
+static volatile long sink;
+static long iterations = 1000000;
+static const char *filter;
+
+// ------------------------------------------------------------------
+// Allocation counter :: malloc() and friends interposed over glibc
+// ------------------------------------------------------------------
+#ifdef __GLIBC__
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t count, size_t size);
+extern void *__libc_realloc(void *mem, size_t size);
+extern void *__libc_memalign(size_t alignment, size_t size);
+extern void __libc_free(void *mem);
+
+static __thread unsigned long allocCount;
+
+void* malloc(size_t size){
+    allocCount++;
+    return __libc_malloc(size);
+}
+
+void* calloc(size_t count, size_t size){
+    allocCount++;
+    return __libc_calloc(count, size);
+}
+
+void* realloc(void *mem, size_t size){
+    allocCount++;
+    return __libc_realloc(mem, size);
+}
+
+void* aligned_alloc(size_t alignment, size_t size){
+    allocCount++;
+    return __libc_memalign(alignment, size);
+}
+
+void free(void *mem){
+    __libc_free(mem);
+}
+#define bench_allocs()  allocCount
+#else
+#define bench_allocs()  0UL
+#endif
+
+// -----------------------------------------------------------------
+// bench_now() :: monotonic time stamp in nanoseconds
+// -----------------------------------------------------------------
+static unsigned long long bench_now(void){
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+// -----------------------------------------------------------------
+// bench_report() :: print one result line
+// -----------------------------------------------------------------
+static void bench_report(
+    const char *name, long n, unsigned long long ns, unsigned long allocs
+){
+    printf(
+        "%-32s %12.1f ns/op %8.2f allocs/op\n",
+        name, (double)ns / n, (double)allocs / n
+    );
+    fflush(stdout);
+}
+
+// -----------------------------------------------------------------
+// bench_time() :: warm up, then time 'n' operations of 'fn'
+// -----------------------------------------------------------------
+static void bench_time(const char *name, bench_fn fn, long arg, long n){
+    unsigned long long start;
+    unsigned long allocs;
+
+    fn(n / 10 + 1, arg);
+    allocs = bench_allocs();
+    start = bench_now();
+    fn(n, arg);
+    bench_report(name, n, bench_now() - start, bench_allocs() - allocs);
+}
+
+// -----------------------------------------------------------------
+// bench_run() :: time 'fn', inside an enclosing 'try' when 'nested'
+// -----------------------------------------------------------------
+static void bench_run(
+    const char *name, bench_fn fn, long arg, long n, int nested
+){
+    if(filter != NULL && strstr(name, filter) == NULL){ return; }
+    if(n < 1){ n = 1; }
+    if(!nested){
+        bench_time(name, fn, arg, n);
+        return;
+    }
+    // the outermost 'try' also sets the context and signal handlers up
+    try{
+        bench_time(name, fn, arg, n);
+    }catch(Exception, e){}finally{}
+}
+
+// -----------------------------------------------------------------
+// bench_lines() :: cache lines spanned by the fields at 'offsets'
+// -----------------------------------------------------------------
+static int bench_lines(const size_t *offsets, const size_t *sizes, int n){
+    unsigned long long mask = 0;
+    int count = 0;
+    for(int i=0; i < n; i++){
+        for(size_t line = offsets[i] / 64;
+            line <= (offsets[i] + sizes[i] - 1) / 64; line++){
+            mask |= 1ULL << (line & 63);
+        }
+    }
+    for(; mask; mask &= mask - 1){ count++; }
+    return count;
+}
+
+// -----------------------------------------------------------------
+// bench_layout() :: size of a frame and a context, and where the fields
+// the try/catch/finally macros touch on every block sit
+// -----------------------------------------------------------------
+static void bench_layout(void){
+    const size_t offsets[] = {
+        offsetof(ExceptionType, state), offsetof(ExceptionType, scope),
+        offsetof(ExceptionType, ready), offsetof(ExceptionType, class),
+        offsetof(ExceptionType, savemask), offsetof(ExceptionType, first),
+    };
+    const size_t sizes[] = {
+        sizeof(State), sizeof(Scope), sizeof(int), sizeof(ObjectRef),
+        sizeof(int), sizeof(int),
+    };
+    printf(
+        "layout: frame %zu B (%zu lines, hot fields in %d), "
+        "context %zu B (%zu lines)\n",
+        sizeof(ExceptionType), (sizeof(ExceptionType) + 63) / 64,
+        bench_lines(offsets, sizes, sizeof(sizes) / sizeof(sizes[0])),
+        sizeof(Context), (sizeof(Context) + 63) / 64
+    );
+}
+
+// ------------------------------------------------------------------
+// Workloads
+// ------------------------------------------------------------------
+
+// -----------------------------------------------------------------
+// exh_descend() :: recurse 'depth' frames, then throw
+// -----------------------------------------------------------------
+static __attribute__((noinline)) long exh_descend(long depth){
+    if(depth <= 1){
+        throw(Exception, NULL);
+        return 0;
+    }
+    return exh_descend(depth - 1) + 1;
+}
+
+// -----------------------------------------------------------------
+// err_descend() :: recurse 'depth' frames, then fail with an error code
+// -----------------------------------------------------------------
+static __attribute__((noinline)) long err_descend(long depth){
+    long result;
+    if(depth <= 1){ return -1; }
+    if((result = err_descend(depth - 1)) < 0){ return result; }
+    return result + 1;
+}
+
+// -----------------------------------------------------------------
+// exh_unwind() :: nest 'depth' try/finally blocks, then throw
+// -----------------------------------------------------------------
+static __attribute__((noinline)) void exh_unwind(long depth){
+    if(depth == 0){ throw(Exception, NULL); }
+    try{
+        exh_unwind(depth - 1);
+    }finally{
+        sink++;
+    }
+}
+
+// -----------------------------------------------------------------
+// err_unwind() :: nest 'depth' cleanups, then fail with an error code
+// -----------------------------------------------------------------
+static __attribute__((noinline)) int err_unwind(long depth){
+    int result;
+    if(depth == 0){ return -1; }
+    result = err_unwind(depth - 1);
+    sink++;
+    return result;
+}
+
+// -----------------------------------------------------------------
+// exh_early_return() :: leave a function with exh_return from a 'try'
+// -----------------------------------------------------------------
+static __attribute__((noinline)) int exh_early_return(void){
+    try{
+        exh_return(1);
+    }catch(Exception, e){
+        sink++;
+    }finally{}
+    return 0;
+}
+
+static void bench_try(long n, long arg){
+    for(long i=0; i < n; i++){
+        try{ sink++; }catch(Exception, e){ sink--; }finally{}
+    }
+}
+
+static void bench_try_nosig(long n, long arg){
+    for(long i=0; i < n; i++){
+        try_nosig{ sink++; }catch(Exception, e){ sink--; }finally{}
+    }
+}
+
+static void bench_throw_nosig(long n, long depth){
+    for(long i=0; i < n; i++){
+        try_nosig{
+            sink += exh_descend(depth);
+        }catch(Exception, e){
+            sink++;
+        }finally{}
+    }
+}
+
+static void bench_catch_ladder(long n, long arg){
+    for(long i=0; i < n; i++){
+        try_nosig{
+            throw(AggregateError, NULL);
+        }catch(OutOfMemoryError, e){
+            sink++;
+        }catch(TimeoutError, e){
+            sink++;
+        }catch(FailedAssertionError, e){
+            sink++;
+        }catch(AggregateError, e){
+            sink++;
+        }finally{}
+    }
+}
+
+static void bench_catch_any(long n, long arg){
+    for(long i=0; i < n; i++){
+        try_nosig{
+            throw(AggregateError, NULL);
+        }catch_any(
+            e, OutOfMemoryError, TimeoutError, FailedAssertionError,
+            AggregateError
+        ){
+            sink++;
+        }finally{}
+    }
+}
+
+// each level catches the exception and passes it on: arg 0 throws it
+// anew, 1 rethrows it, 2 wraps it
+static void exh_pass_on(long depth, long how){
+    if(depth == 0){ throw(AggregateError, NULL); }
+    try_nosig{
+        exh_pass_on(depth - 1, how);
+    }catch(AggregateError, e){
+        if(how == 0){ throw(e->class, e->data); }
+        if(how == 1){ exh_rethrow(); }
+        throw_with_cause(AggregateError, NULL, e);
+    }finally{}
+}
+
+static void bench_pass_on(long n, long how){
+    for(long i=0; i < n; i++){
+        try_nosig{
+            exh_pass_on(4, how);
+        }catch(AggregateError, e){
+            sink++;
+        }finally{}
+    }
+}
+
+static void bench_throw(long n, long depth){
+    for(long i=0; i < n; i++){
+        try{
+            sink += exh_descend(depth);
+        }catch(Exception, e){
+            sink++;
+        }finally{}
+    }
+}
+
+static void bench_err_throw(long n, long depth){
+    for(long i=0; i < n; i++){
+        if(err_descend(depth) < 0){ sink++; }
+    }
+}
+
+static void bench_cxx_try(long n, long arg){
+    cxxbench_try(n);
+}
+
+static void bench_cxx_throw(long n, long depth){
+    cxxbench_throw(n, depth);
+}
+
+static void bench_unwind(long n, long depth){
+    for(long i=0; i < n; i++){
+        try{ exh_unwind(depth); }catch(Exception, e){ sink++; }finally{}
+    }
+}
+
+static void bench_err_unwind(long n, long depth){
+    for(long i=0; i < n; i++){
+        if(err_unwind(depth) < 0){ sink++; }
+    }
+}
+
+static void bench_cxx_unwind(long n, long depth){
+    cxxbench_unwind(n, depth);
+}
+
+static void bench_return(long n, long arg){
+    for(long i=0; i < n; i++){
+        sink += exh_early_return();
+    }
+}
+
+static void bench_signal(long n, long arg){
+    for(long i=0; i < n; i++){
+        try{
+            raise(SIGFPE);
+        }catch(ArithmethicError, e){
+            sink++;
+        }finally{}
+    }
+}
+
+static void bench_stack(long n, long arg){
+    Stack *stack = stack_new();
+    for(long i=0; i < n; i++){
+        stack_push(stack, (void*)(i + 1));    // NULL is no entry
+        if(stack_len(stack) == arg){
+            while(stack_len(stack) > 0){ sink += (long)stack_pop(stack); }
+        }
+    }
+    stack_delete(stack);
+}
+
+static void bench_list(long n, long arg){
+    List *list = list_new();
+    for(long i=0; i < n; i++){
+        list_append(list, (void*)(i + 1));
+        if(list_len(list) == arg){
+            while(list_len(list) > 0){
+                sink += (long)list_remove_head(list);
+            }
+        }
+    }
+    list_delete(list);
+}
+
+static void bench_dict(long n, long arg){
+    Dict *dict = dict_new();
+    for(long i=0; i < n; i++){
+        dict_put(dict, (int)(i % arg), (void*)(i + 1));
+        sink += (long)dict_get(dict, (int)((i * 7) % arg));
+        if(i % arg == arg - 1){
+            for(long key=0; key < arg; key++){ dict_remove(dict, (int)key); }
+        }
+    }
+    dict_delete(dict);
+}
+
+// ------------------------------------------------------------------
+// Contention :: exhget_context() from N threads at once
+// ------------------------------------------------------------------
+#ifdef EXHANDLER_USE_PTHREAD
+typedef struct Contender{
+    pthread_t thread;
+    pthread_barrier_t *barrier;
+    long n;
+    int intry;
+    unsigned long long ns;
+    unsigned long allocs;
+} Contender;
+
+// -----------------------------------------------------------------
+// bench_lookup() :: look the context of the calling thread up 'n' times
+// -----------------------------------------------------------------
+static void bench_lookup(Contender *self){
+    unsigned long long start;
+    unsigned long allocs;
+
+    pthread_barrier_wait(self->barrier);
+    allocs = bench_allocs();
+    start = bench_now();
+    for(long i=0; i < self->n; i++){
+        sink += exhget_context(NULL) != NULL;
+    }
+    self->ns = bench_now() - start;
+    self->allocs = bench_allocs() - allocs;
+}
+
+// -----------------------------------------------------------------
+// bench_contender() :: thread body, outside a 'try' the lookup is locked
+// -----------------------------------------------------------------
+static void* bench_contender(void *arg){
+    Contender *self = arg;
+    if(self->intry){
+        try{ bench_lookup(self); }catch(Exception, e){}finally{}
+    }else{
+        bench_lookup(self);
+    }
+
+    return NULL;
+}
+
+// -----------------------------------------------------------------
+// bench_contention() :: run 'nthreads' contenders, report the average
+// -----------------------------------------------------------------
+static void bench_contention(const char *name, int nthreads, int intry){
+    Contender contenders[64];
+    pthread_barrier_t barrier;
+    unsigned long long ns = 0;
+    unsigned long allocs = 0;
+
+    if(filter != NULL && strstr(name, filter) == NULL){ return; }
+    pthread_barrier_init(&barrier, NULL, nthreads);
+    for(int i=0; i < nthreads; i++){
+        contenders[i].barrier = &barrier;
+        contenders[i].n = iterations;
+        contenders[i].intry = intry;
+        pthread_create(
+            &contenders[i].thread, NULL, bench_contender, &contenders[i]
+        );
+    }
+    for(int i=0; i < nthreads; i++){
+        pthread_join(contenders[i].thread, NULL);
+        ns += contenders[i].ns;
+        allocs += contenders[i].allocs;
+    }
+    pthread_barrier_destroy(&barrier);
+    bench_report(name, iterations * nthreads, ns, allocs);
+}
+#endif
+
+int main(int argc, char **argv){
+    static const long depths[] = {1, 2, 4, 8, 16, 32, 64};
+    char name[64];
+
+    for(int i=1; i < argc; i++){
+        if(strcmp(argv[i], "-n") == 0 && i + 1 < argc){
+            iterations = atol(argv[++i]);
+        }else{
+            filter = argv[i];
+        }
+    }
+#ifdef EXHANDLER_USE_PTHREAD
+    printf("exhbench: pthread, ");
+#else
+    printf("exhbench: single thread, ");
+#endif
+#if defined(EXHANDLER_SHARED_MEMORY)
+    printf("shared memory\n");
+#elif defined(EXHANDLER_PRIVATE_MEMORY)
+    printf("private memory\n");
+#else
+    printf("no thread memory\n");
+#endif
+    bench_layout();
+
+    bench_run("try/nothrow/outermost", bench_try, 0, iterations / 10, 0);
+    bench_run("try/nothrow", bench_try, 0, iterations, 1);
+    bench_run("try/nothrow/c++", bench_cxx_try, 0, iterations, 0);
+    bench_run(
+        "try_nosig/nothrow/outermost", bench_try_nosig, 0, iterations / 10, 0
+    );
+    bench_run("try_nosig/nothrow", bench_try_nosig, 0, iterations, 1);
+    bench_run("try_nosig/throw", bench_throw_nosig, 1, iterations / 10, 1);
+    bench_run("catch/ladder-4", bench_catch_ladder, 0, iterations / 10, 1);
+    bench_run("catch/any-4", bench_catch_any, 0, iterations / 10, 1);
+    bench_run("rethrow/depth-4/throw", bench_pass_on, 0, iterations / 10, 1);
+    bench_run("rethrow/depth-4", bench_pass_on, 1, iterations / 10, 1);
+    bench_run("rethrow/depth-4/cause", bench_pass_on, 2, iterations / 10, 1);
+    for(int i=0; i < (int)(sizeof(depths) / sizeof(depths[0])); i++){
+        long n = iterations / 10;
+        snprintf(name, sizeof(name), "throw/depth-%ld", depths[i]);
+        bench_run(name, bench_throw, depths[i], n, 1);
+        snprintf(name, sizeof(name), "throw/depth-%ld/errcode", depths[i]);
+        bench_run(name, bench_err_throw, depths[i], n, 0);
+        snprintf(name, sizeof(name), "throw/depth-%ld/c++", depths[i]);
+        bench_run(name, bench_cxx_throw, depths[i], n, 0);
+    }
+    bench_run("finally/unwind-8", bench_unwind, 8, iterations / 10, 1);
+    bench_run(
+        "finally/unwind-8/errcode", bench_err_unwind, 8, iterations / 10, 0
+    );
+    bench_run("finally/unwind-8/c++", bench_cxx_unwind, 8, iterations / 10, 0);
+    bench_run("exh_return", bench_return, 0, iterations / 10, 1);
+    bench_run("signal/SIGFPE", bench_signal, 0, iterations / 10, 1);
+#ifdef EXHANDLER_USE_PTHREAD
+    for(int nthreads=1; nthreads <= 8; nthreads *= 2){
+        // outside a 'try' the lookup goes through the locked dictionary
+        snprintf(name, sizeof(name), "exhget_context/%d-threads", nthreads);
+        bench_contention(name, nthreads, 1);
+        snprintf(
+            name, sizeof(name), "exhget_context/%d-threads/locked", nthreads
+        );
+        bench_contention(name, nthreads, 0);
+    }
+#endif
+    bench_run("stack/push-pop-64", bench_stack, 64, iterations, 0);
+    bench_run("list/append-remove-64", bench_list, 64, iterations, 0);
+    bench_run("dict/put-get-remove-64", bench_dict, 64, iterations, 0);
+
+    return 0;
+}
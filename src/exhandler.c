@@ -1,9 +1,81 @@
+#if defined(EXHANDLER_BACKTRACE) || defined(EXHANDLER_DEADLINE)
+#define _GNU_SOURCE     /* dladdr(), SIGEV_THREAD_ID */
+#endif
 #include<string.h>
+#include<stdint.h>
 #ifdef EXHANDLER_USE_PTHREAD
 #include<pthread.h>
 #endif
+#ifdef EXHANDLER_HEAP_PROFILE
+#include<math.h>
+#endif
+#if defined(EXHANDLER_TIMING) || defined(EXHANDLER_EVENTS) || \
+    defined(EXHANDLER_FLIGHT_RECORDER) || defined(EXHANDLER_DEADLINE)
+#include<time.h>
+#endif
+#include<errno.h>
+#include<unistd.h>
+#ifdef EXHANDLER_FLIGHT_RECORDER
+#include<fcntl.h>
+#include<sys/mman.h>
+#endif
+#ifdef EXHANDLER_BACKTRACE
+#include<dlfcn.h>
+#include<execinfo.h>
+#endif
+#ifdef EXHANDLER_DEADLINE
+#include<sys/syscall.h>
+#endif
 #include "exhandler.h"
 
+#define threadContext   exhcurrent_context  // read by exhandler.h
+static size_t exhmem_release_reserve(void);
+typedef struct ProfileSample ProfileSample;
+#ifdef EXHANDLER_HEAP_PROFILE
+static void exhprof_record(void *mem, size_t size, char *filename, int lineno);
+static void exhprof_forget(void *mem);
+static ProfileSample* exhprof_find(void *mem);
+static void exhprof_drop(ProfileSample *sample);
+#else
+#define exhprof_record(mem, size, filename, lineno)
+#define exhprof_forget(mem)
+#define exhprof_find(mem)                       NULL
+#define exhprof_drop(sample)                    ((void)(sample))
+#endif
+#ifdef EXHANDLER_EVENTS
+static int exhevent_record(
+    int kind, ObjectRef class, char *filename, int lineno, char *detail,
+    int depth
+);
+#else
+static inline int exhevent_record(
+    int kind, ObjectRef class, char *filename, int lineno, char *detail,
+    int depth
+){ return 0; }
+#endif
+#ifdef EXHANDLER_FLIGHT_RECORDER
+static void exhflight_record(
+    int kind, ObjectRef class, char *filename, int lineno, Context *context
+);
+#else
+#define exhflight_record(kind, class, filename, lineno, context)
+#endif
+#ifdef EXHANDLER_REGISTRY
+static void exhregistry_push(char *filename, int lineno);
+static void exhregistry_pop(void);
+static void exhregistry_except(
+    ObjectRef class, State state, char *filename, int lineno
+);
+#else
+#define exhregistry_push(filename, lineno)
+#define exhregistry_pop()
+#define exhregistry_except(class, state, filename, lineno)
+#endif
+#ifdef EXHANDLER_DEADLINE
+static void exhdeadline_set(unsigned long long deadline);
+static void exhdeadline_retry(void);
+static int exhdeadline_expired(void);
+#endif
 
 /********************************************************************/
 /*                 Allocation routines Implementation               */
@@ -12,21 +84,79 @@
 void* exhmem_calloc(
     Context *cptr, int num, int size, char *filename, int lineno
 ){
-    void *mem;
-    mem = calloc(num, (size_t)size);
-    if(mem == NULL){
+    if(num < 0 || size < 0){
         exhthrow(cptr, OutOfMemoryError, NULL, filename, lineno);
+        return NULL;
     }
-
-    return mem;
+    return exhmem_calloc_size(cptr, num, size, filename, lineno);
 }
 
 // -- 37
 void* exhmem_malloc(
     Context *cptr, int size, char *filename, int lineno
+){
+    if(size < 0){
+        exhthrow(cptr, OutOfMemoryError, NULL, filename, lineno);
+        return NULL;
+    }
+    return exhmem_malloc_size(cptr, size, filename, lineno);
+}
+
+// -- 38
+void* exhmem_realloc(
+    Context *cptr, void *mem, int size, char *filename, int lineno
+){
+    if(size < 0){
+        exhthrow(cptr, OutOfMemoryError, NULL, filename, lineno);
+        return NULL;
+    }
+    return exhmem_realloc_size(cptr, mem, size, filename, lineno);
+}
+
+// -- 54
+void exhmem_free(Context *cptr, void *mem, char *filename, int lineno){
+    EXH_BUSY_BEGIN(threadContext);
+    exhprof_forget(mem);
+    free(mem);
+    EXH_BUSY_END(threadContext);
+}
+
+// -- 59
+void* exhmem_calloc_size(
+    Context *cptr, size_t num, size_t size, char *filename, int lineno
+){
+    void *mem = NULL;
+    // malloc() cut short by an asynchronous exception would leave its lock
+    EXH_BUSY_BEGIN(threadContext);
+    if(size == 0 || num <= SIZE_MAX / size){
+        mem = calloc(num, size);
+    }
+    if(mem == NULL){
+        exhmem_release_reserve();
+    }else{
+        exhprof_record(mem, num * size, filename, lineno);
+    }
+    EXH_BUSY_END(threadContext);
+    if(mem == NULL){
+        exhthrow(cptr, OutOfMemoryError, NULL, filename, lineno);
+    }
+
+    return mem;
+}
+
+// -- 60
+void* exhmem_malloc_size(
+    Context *cptr, size_t size, char *filename, int lineno
 ){
     void *mem;
-    mem = malloc((size_t)size);
+    EXH_BUSY_BEGIN(threadContext);
+    mem = malloc(size);
+    if(mem == NULL){
+        exhmem_release_reserve();
+    }else{
+        exhprof_record(mem, size, filename, lineno);
+    }
+    EXH_BUSY_END(threadContext);
     if(mem == NULL){
         exhthrow(cptr, OutOfMemoryError, NULL, filename, lineno);
     }
@@ -34,18 +164,52 @@ void* exhmem_malloc(
     return mem;
 }
 
-// -- 38
-void* exhmem_realloc(
-    Context *cptr, void *mem, int size, char *filename, int lineno
+// -- 61
+void* exhmem_realloc_size(
+    Context *cptr, void *mem, size_t size, char *filename, int lineno
 ){
     void *segment;
+    ProfileSample *sample;
+    EXH_BUSY_BEGIN(threadContext);
+    // looked up while 'mem' is live, dropped once realloc() freed it
+    sample = exhprof_find(mem);
     segment = realloc(mem, size);
+    if(segment == NULL){
+        // 'mem' is still live, and still sampled
+        exhmem_release_reserve();
+    }else{
+        exhprof_drop(sample);
+        exhprof_record(segment, size, filename, lineno);
+    }
+    EXH_BUSY_END(threadContext);
     if(segment == NULL){
         exhthrow(cptr, OutOfMemoryError, NULL, filename, lineno);
     }
     return segment;
 }
 
+// -- 62
+void* exhmem_aligned_alloc(
+    Context *cptr, size_t alignment, size_t size, char *filename, int lineno
+){
+    void *mem = NULL;
+    assert(alignment != 0 && (alignment & (alignment - 1)) == 0);
+    if(alignment < sizeof(void*)){ alignment = sizeof(void*); }
+    EXH_BUSY_BEGIN(threadContext);
+    if(posix_memalign(&mem, alignment, size) != 0){ mem = NULL; }
+    if(mem == NULL){
+        exhmem_release_reserve();
+    }else{
+        exhprof_record(mem, size, filename, lineno);
+    }
+    EXH_BUSY_END(threadContext);
+    if(mem == NULL){
+        exhthrow(cptr, OutOfMemoryError, NULL, filename, lineno);
+    }
+
+    return mem;
+}
+
 /********************************************************************/
 /*                  Assertion routine Implementation                */
 /********************************************************************/
@@ -60,11 +224,15 @@ void exhhandle_assertion(
         }
         exhthrow(cptr, FailedAssertionError, expr, filename, lineno);
     }else{
-        fprintf(
-            stderr, "Assertion Failure %s: %s, file \"%s\", line %d.\n",
-            flag ? "" : "(no abort)", expr, filename, lineno
-        );
-        if(flag){ abort(); }
+        if(!exhevent_record(
+            EXH_EVENT_ASSERT, FailedAssertionError, filename, lineno, expr, 0
+        ) || flag){
+            fprintf(
+                stderr, "Assertion Failure %s: %s, file \"%s\", line %d.\n",
+                flag ? "" : "(no abort)", expr, filename, lineno
+            );
+        }
+        if(flag){ exhevent_drain(); abort(); }
     }
 }
 
@@ -73,7 +241,7 @@ void exhhandle_assertion(
 /********************************************************************/
 
 Context *cptr = NULL;
-Object Throwable = {.norethrow = 1, .parent=NULL, .name="Throwable", };
+Object Throwable = {{.norethrow = 1, .parent=NULL, .name="Throwable", }};
 
 EXH_DEFINE(Exception, Throwable);
 EXH_DEFINE(OutOfMemoryError, Exception);
@@ -84,18 +252,23 @@ EXH_DEFINE(ArithmethicError, RuntimeError);            /* SIGFPE */
 EXH_DEFINE(IllegalInstructionError, RuntimeError);     /* SIGABRT */
 EXH_DEFINE(SegmentationError, RuntimeError);           /* SIGABRT */
 EXH_DEFINE(BusError, RuntimeError);                    /* SIGABRT */
+EXH_DEFINE(AggregateError, Exception);
+EXH_DEFINE(TimeoutError, Exception);
 
 #if defined(EXHANDLER_SHARED_MEMORY) || defined(EXHANDLER_PRIVATE_MEMORY)
 #define EXHANDLER_MULTI_THREADING     1
+#define EXHANDLER_THREAD_LOCAL        __thread
 #ifdef EXHANDLER_USE_PTHREAD
 #define EXHANDLER_THREAD_ID_FUNC        (int)pthread_self
 #define EXHANDLER_THREAD_MUTEX_FUNC     exhmutex
 #else
 extern int EXHANDLER_THREAD_ID_FUNC(void);
-extern int EXHANDLER_MUTEX_FUNC(int mode);
+extern int EXHANDLER_THREAD_MUTEX_FUNC(int mode);
 #endif
 #else
 #define EXHANDLER_MULTI_THREADING       0
+#define EXHANDLER_THREAD_ID_FUNC()      0
+#define EXHANDLER_THREAD_LOCAL
 #define EXHANDLER_THREAD_MUTEX_FUNC(mode)
 #endif
 
@@ -105,15 +278,58 @@ extern int EXHANDLER_MUTEX_FUNC(int mode);
 #define EXHANDLER_SHARE     0
 #endif
 
-static Object ReturnEvent = {.norethrow=1, .parent=NULL, .name="ReturnEvent",};
+// ------------------------------------------------------------------
+// Static probes :: USDT tracepoints, see 'readelf -n' for the notes
+// ------------------------------------------------------------------
+// Probes of provider 'exhandler', each takes (class name, file, line,
+// 'try' depth, thread), 'signal' adds the signal number. Every probe is
+// guarded by its semaphore, set by the tracer when it attaches.
+//      try_begin, throw, catch, finally_begin, signal
+#ifdef EXHANDLER_USDT
+#define _SDT_HAS_SEMAPHORES 1
+#include<sys/sdt.h>
+
+#define EXH_PROBE_SEMAPHORE(name)                                   \
+    unsigned short exhandler_##name##_semaphore                     \
+    __attribute__((unused, section(".probes")))
+
+EXH_PROBE_SEMAPHORE(try_begin);
+EXH_PROBE_SEMAPHORE(throw);
+EXH_PROBE_SEMAPHORE(catch);
+EXH_PROBE_SEMAPHORE(finally_begin);
+EXH_PROBE_SEMAPHORE(signal);
+
+#define EXH_PROBE(name, class, filename, lineno, depth)             \
+    if(__builtin_expect(exhandler_##name##_semaphore, 0)){          \
+        STAP_PROBE5(                                                \
+            exhandler, name, class, filename, lineno, depth,        \
+            EXHANDLER_THREAD_ID_FUNC()                              \
+        );                                                          \
+    }
+
+#define EXH_PROBE_SIGNAL(class, depth, signum)                      \
+    if(__builtin_expect(exhandler_signal_semaphore, 0)){            \
+        STAP_PROBE6(                                                \
+            exhandler, signal, class, "?", 0, depth,                \
+            EXHANDLER_THREAD_ID_FUNC(), signum                      \
+        );                                                          \
+    }
+#else
+#define EXH_PROBE(name, class, filename, lineno, depth)
+#define EXH_PROBE_SIGNAL(class, depth, signum)
+#endif /* EXHANDLER_USDT */
+
+static Object ReturnEvent = {{.norethrow=1, .parent=NULL, .name="ReturnEvent",}};
 static Context defaultContext;
-static volatile Dict *contextDict;
+static Dict *volatile contextDict;
+EXHANDLER_THREAD_LOCAL Context *threadContext =     // signal-safe lookup
+    EXHANDLER_MULTI_THREADING ? NULL : &defaultContext;
 static volatile int numThreadsTry;
-static exh_sighandlerFn shared_abort_handlerfn;
-static exh_sighandlerFn shared_fpe_handlerfn;
-static exh_sighandlerFn shared_ill_handlerfn;
-static exh_sighandlerFn shared_segv_handlerfn;
-static exh_sighandlerFn shared_bus_handlerfn;
+static struct sigaction shared_abort_action;
+static struct sigaction shared_fpe_action;
+static struct sigaction shared_ill_action;
+static struct sigaction shared_segv_action;
+static struct sigaction shared_bus_action;
 
 // ------------------------------------------------------------------
 // exhmutex() - lock/unlock for thread shared data access
@@ -122,7 +338,7 @@ static exh_sighandlerFn shared_bus_handlerfn;
 // mode = 1 ==> lock
 // mode = 0 ==> unlock
 static void exhmutex(int mode){
-    static volatile pthread_mutex_t mutex;
+    static pthread_mutex_t mutex;
     static volatile sig_atomic_t initialized;
     static volatile sig_atomic_t ready;
     static volatile int count;
@@ -163,7 +379,7 @@ static void exhmutex(int mode){
 #ifdef EXHANDLER_DEBUG
 static void exhprint_debug(Context *cptr, char *name){
     if(cptr == NULL){
-        cptr exhget_context(NULL);
+        cptr = exhget_context(NULL);
     }
     for(int i=(cptr && cptr->stack) ? stack_len(cptr->stack):0; i != 0; i--){
         fputs(" ", stderr);
@@ -175,211 +391,2601 @@ static void exhprint_debug(Context *cptr, char *name){
 #define exhprint_debug(cpr, name)
 #endif
 
-// -- 40
-Scope exhget_scope(Context *cptr){
-    Scope scope;
-    if(cptr == NULL){
-        cptr = exhget_context(NULL);
-    }
-    exhprint_debug(cptr, "exhget_scope");
-    if(cptr == NULL || cptr->except == NULL){ scope = OUTSITE_SCOPE; }
-    else{
-        scope = ((ExceptionType*)stack_peek(cptr->stack, 1))->scope;
+// ------------------------------------------------------------------
+// Emergency reserve :: memory given back to the heap on OutOfMemoryError
+// ------------------------------------------------------------------
+static void *processReserve;
+static size_t processReserveSize;
+static int processReserveSet;       // by exhmem_set_reserve() or the default
+static EXHANDLER_THREAD_LOCAL void *threadReserve;
+static EXHANDLER_THREAD_LOCAL size_t threadReserveSize;
+static volatile exh_reserveFn reserve_hookfn;
+
+// -----------------------------------------------------------------
+// exhmem_new_reserve() :: allocate a reserve block and commit its pages
+// -----------------------------------------------------------------
+static void* exhmem_new_reserve(size_t size){
+    void *block = NULL;
+    if(size > 0 && (block = malloc(size)) != NULL){
+        // touch the pages, an uncommitted reserve would release nothing
+        memset(block, 0, size);
     }
-    return scope;
+    return block;
 }
 
-// -- 41
-Context* exhget_context(Context *cptr){
-#if EXHANDLER_MULTI_THREADING
-    EXHANDLER_THREAD_MUTEX_FUNC(1)
-    if(cptr == NULL && contextDict != NULL){
-        cptr = dict_get(contextDict, EXHANDLER_THREAD_ID_FUNC());
+// -----------------------------------------------------------------
+// exhmem_default_reserve() :: EXH_RESERVE_DEFAULT_SIZE process reserve,
+// set up by the first 'try' unless exhmem_set_reserve() came first
+// -----------------------------------------------------------------
+static void exhmem_default_reserve(void){
+    EXHANDLER_THREAD_MUTEX_FUNC(1);
+    if(!processReserveSet){
+        processReserve = exhmem_new_reserve(EXH_RESERVE_DEFAULT_SIZE);
+        processReserveSize = EXH_RESERVE_DEFAULT_SIZE;
+        __atomic_store_n(&processReserveSet, 1, __ATOMIC_RELEASE);
     }
-    EXHANDLER_THREAD_MUTEX_FUNC(0)
-    return cptr;
-#else
-    return &defaultContext;
-#endif
+    EXHANDLER_THREAD_MUTEX_FUNC(0);
 }
 
 // -----------------------------------------------------------------
-// exhnew_context() :: create exception handling context for thread
+// exhmem_release_reserve() :: give reserve(s) back before OOM is thrown
 // -----------------------------------------------------------------
-#if EXHANDLER_MULTI_THREADING
-static Context* exhnew_context(void){
-    Context *context;
-    context = calloc(1, sizeof(Context));
-    if(context == NULL){
-        fprintf(stderr, "exhandler internal error: out of memory.\n");
+static size_t exhmem_release_reserve(void){
+    size_t released = 0;
+    exh_reserveFn hookfn;
+
+    if(threadReserve != NULL){
+        free(threadReserve);
+        threadReserve = NULL;
+        released += threadReserveSize;
+    }else{
+        EXHANDLER_THREAD_MUTEX_FUNC(1);
+        if(processReserve != NULL){
+            free(processReserve);
+            processReserve = NULL;
+            released += processReserveSize;
+        }
+        EXHANDLER_THREAD_MUTEX_FUNC(0);
+    }
+    if(released > 0 && (hookfn = reserve_hookfn) != NULL){
+        hookfn(released);
     }
+
+    return released;
+}
+
+// -- 50
+int exhmem_set_reserve(size_t size){
+    int status;
     EXHANDLER_THREAD_MUTEX_FUNC(1);
-    dict_put(contextDict, EXHANDLER_THREAD_ID_FUNC(), context);
+    free(processReserve);
+    processReserve = exhmem_new_reserve(size);
+    processReserveSize = size;
+    __atomic_store_n(&processReserveSet, 1, __ATOMIC_RELEASE);
+    status = (size == 0 || processReserve != NULL);
     EXHANDLER_THREAD_MUTEX_FUNC(0);
-    exhprint_debug(context, "exhnew_conext");
 
-    return context;
+    return status;
 }
-#else
-#define exhnew_context()    NULL
-#endif
 
-// -----------------------------------------------------------------
-// exhget_description()
-// -----------------------------------------------------------------
-static char* exhget_description(void){
-    Context *context = exhget_context(NULL);
-    exhprint_debug(context, "exhget_description");
-    sprintf(
-        context->description, "%s: file \"%s\", line %d.",
-        context->except->class->name, context->except->filename,
-        context->except->lineno
-    );
+// -- 51
+int exhmem_set_thread_reserve(size_t size){
+    free(threadReserve);
+    threadReserve = exhmem_new_reserve(size);
+    threadReserveSize = size;
 
-    return context->description;
+    return size == 0 || threadReserve != NULL;
 }
 
-// -----------------------------------------------------------------
-// exhget_class() :: get current exception class
-// -----------------------------------------------------------------
-static ObjectRef exhget_class(void){
-    Context *context = exhget_context(NULL);
-    exhprint_debug(context, "exhget_class");
-    return context->except->class;
+// -- 52
+exh_reserveFn exhmem_set_reserve_hook(exh_reserveFn hookfn){
+    exh_reserveFn oldfn = reserve_hookfn;
+    reserve_hookfn = hookfn;
+    return oldfn;
+}
+
+// -- 53
+int exhmem_refill_reserve(void){
+    int status = 1;
+    if(threadReserve == NULL && threadReserveSize > 0){
+        threadReserve = exhmem_new_reserve(threadReserveSize);
+        status = threadReserve != NULL;
+    }
+    EXHANDLER_THREAD_MUTEX_FUNC(1);
+    if(processReserve == NULL && processReserveSize > 0){
+        processReserve = exhmem_new_reserve(processReserveSize);
+        status = status && processReserve != NULL;
+    }
+    EXHANDLER_THREAD_MUTEX_FUNC(0);
+
+    return status;
 }
 
+// ------------------------------------------------------------------
+// Heap profiler :: sampled live/total bytes per exhmem_* call site
+// ------------------------------------------------------------------
+#ifdef EXHANDLER_HEAP_PROFILE
+#define EXH_PROFILE_SITES       512     /* per thread, power of 2 */
+#define EXH_PROFILE_SAMPLES     4096    /* live samples, power of 2 */
+#define EXH_PROFILE_PROBE       16      /* slots searched for a block */
+#define EXH_PROFILE_TOMBSTONE   ((void*)1)
+
+typedef struct ProfileSite{
+    char *filename;
+    int lineno;
+    size_t allocs;
+    size_t bytes;
+    size_t liveallocs;      // updated atomically, frees may be remote
+    size_t livebytes;
+} ProfileSite;
+
+typedef struct ProfileTable ProfileTable;
+struct ProfileTable{
+    ProfileTable *next;
+    size_t untilsample;
+    uint64_t seed;
+    ProfileSite sites[EXH_PROFILE_SITES];
+};
+
+typedef struct ProfileSample{
+    void *mem;
+    ProfileSite *site;
+    size_t allocs;
+    size_t bytes;
+} ProfileSample;
+
+static volatile size_t profileInterval;
+static ProfileTable *volatile profileTables;
+static EXHANDLER_THREAD_LOCAL ProfileTable *profileTable;
+static ProfileSample profileSamples[EXH_PROFILE_SAMPLES];
+static volatile size_t profileLive;
+static volatile size_t profileDropped;
+static char *profileDumpFile;
+
 // -----------------------------------------------------------------
-// exhget_data() :: get current exception associated data
+// exhprof_next_interval() :: exponentially distributed sampling gap
 // -----------------------------------------------------------------
-static void* exhget_data(void){
-    Context *context = exhget_context(NULL);
-    exhprint_debug(context, "exhget_data");
-    return context->except->data;
+static size_t exhprof_next_interval(ProfileTable *table){
+    double u;
+    table->seed ^= table->seed << 13;
+    table->seed ^= table->seed >> 7;
+    table->seed ^= table->seed << 17;
+    u = ((table->seed >> 11) + 1) * (1.0 / 9007199254740993.0);
+    return (size_t)(-log(u) * profileInterval) + 1;
 }
 
 // -----------------------------------------------------------------
-// exhprind_stacktrace() :: print the nested 'try' trace
+// exhprof_new_table() :: create and publish the calling thread's table
 // -----------------------------------------------------------------
-static void exhprint_stacktrace(FILE *fileptr){
-    Context *context = exhget_context(NULL);
-    exhprint_debug(context, "exhprint_stacktrace");
-    if(fileptr == NULL){ fileptr = stderr; }
+static ProfileTable* exhprof_new_table(void){
+    ProfileTable *table = calloc(1, sizeof(ProfileTable));
+    if(table == NULL){ return NULL; }
+    table->seed = (uintptr_t)table ^ 0x9E3779B97F4A7C15ULL;
+    table->untilsample = exhprof_next_interval(table);
+    // tables outlive their threads, a dump still sees what they allocated
+    do{
+        table->next = profileTables;
+    }while(!__atomic_compare_exchange_n(
+        &profileTables, &table->next, table, 0,
+        __ATOMIC_RELEASE, __ATOMIC_RELAXED
+    ));
 
-#if EXHANDLER_MULTI_THREADING
-    fprintf(
-        fileptr, "%s occured in thread %d:\n",
-        cptr->except->class->name, EXHANDLER_THREAD_ID_FUNC()
-    );
-#else
-    fprintf(fileptr, "%s occured:\n", cptr->except->class->name);
-#endif
-    for(int i=1; i <= stack_len(cptr->except); i++){
-        ExceptionType *except = stack_peek(context->stack, i);
-        fprintf(
-            fileptr, "      in 'try' at %s:%d\n",
-            except->tryfile, except->trylineno
-        );
-    }
+    return profileTable = table;
 }
 
 // -----------------------------------------------------------------
-// exhthrow_signal() :: 'throw' exception caused by signal
+// exhprof_get_site() :: find or claim the table slot of a call site
 // -----------------------------------------------------------------
-static void exhthrow_signal(int num){
-    ObjectRef objref;
-    exhprint_debug(cptr, "exhthrow_signal");
-    switch(num){
-    case SIGABRT:
-        objref = AbnormalTerminationError;
-        break;
-    case SIGFPE:
-        objref = ArithmethicError;
-        break;
-    case SIGILL:
-        objref = IllegalInstructionError;
-        break;
-    case SIGSEGV:
-        objref = SegmentationError;
-        break;
-#ifdef SIGBUS
-    case SIGBUS:
-        objref = BusError;
-        break;
-#endif
+static ProfileSite* exhprof_get_site(
+    ProfileTable *table, char *filename, int lineno
+){
+    unsigned hash = ((unsigned)(uintptr_t)filename >> 3) * 40503u + lineno;
+    for(int i=0; i < EXH_PROFILE_SITES; i++){
+        ProfileSite *site;
+        site = &table->sites[(hash + i) & (EXH_PROFILE_SITES - 1)];
+        if(site->filename == filename && site->lineno == lineno){
+            return site;
+        }
+        if(site->filename == NULL){
+            site->lineno = lineno;
+            __atomic_store_n(&site->filename, filename, __ATOMIC_RELEASE);
+            return site;
+        }
     }
 
-    signal(num, exhthrow_signal);
-    objref->signum = num;
-    exhthrow(NULL, objref, NULL, "?", 0);
+    return NULL;
 }
 
 // -----------------------------------------------------------------
-// exhinstall_handlers() :: Install signal/trap handler if needed
+// exhprof_record() :: account an allocation if it is sampled
 // -----------------------------------------------------------------
-static int exhinstall_handlers(Context *context){
-    int stored = 0;
-    if(context->stack == NULL){
-        EXHANDLER_THREAD_MUTEX_FUNC(1);
-        if(EXHANDLER_MULTI_THREADING && EXHANDLER_SHARE && numThreadsTry++ ==0){
-            shared_abort_handlerfn = signal(SIGABRT, exhthrow_signal);
-            shared_fpe_handlerfn = signal(SIGFPE, exhthrow_signal);
-            shared_ill_handlerfn = signal(SIGILL, exhthrow_signal);
-            shared_segv_handlerfn = signal(SIGSEGV, exhthrow_signal);
-#ifdef SIGBUS
-            shared_bus_handlerfn = signal(SIGBUS, exhthrow_signal);
-#endif
-            stored = 1;
-        }else if(!EXHANDLER_MULTI_THREADING || !EXHANDLER_SHARE){
-            context->aborthandler = signal(SIGABRT, exhthrow_signal);
-            context->fpehandler = signal(SIGFPE, exhthrow_signal);
-            context->illhandler = signal(SIGILL, exhthrow_signal);
-            context->segvhandler = signal(SIGSEGV, exhthrow_signal);
-#ifdef SIGBUS
-            context->bushandler = signal(SIGSEGV, exhthrow_signal);
-#endif
-            stored = 1;
-        }
-        EXHANDLER_THREAD_MUTEX_FUNC(0);
+static void exhprof_record(void *mem, size_t size, char *filename, int lineno){
+    ProfileTable *table;
+    ProfileSite *site;
+    double probability;
+    size_t allocs, bytes;
+    unsigned hash;
+
+    if(profileInterval == 0 || mem == NULL){ return; }
+    if((table = profileTable) == NULL && (table = exhprof_new_table())==NULL){
+        return;
+    }
+    if(size < table->untilsample){
+        table->untilsample -= size;
+        return;
+    }
+    table->untilsample = exhprof_next_interval(table);
+    if((site = exhprof_get_site(table, filename, lineno)) == NULL){
+        __atomic_add_fetch(&profileDropped, 1, __ATOMIC_RELAXED);
+        return;
     }
 
-    return stored;
+    // weight the sample by the inverse of its sampling probability
+    probability = 1.0 - exp(-(double)size / profileInterval);
+    allocs = (size_t)(1.0 / probability + 0.5);
+    bytes = (size_t)(size / probability + 0.5);
+    site->allocs += allocs;
+    site->bytes += bytes;
+    __atomic_add_fetch(&site->liveallocs, allocs, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&site->livebytes, bytes, __ATOMIC_RELAXED);
+
+    // a block is kept near its home slot, a free looks no further
+    hash = (unsigned)((uintptr_t)mem >> 4) * 40503u;
+    for(int i=0; i < EXH_PROFILE_PROBE; i++){
+        ProfileSample *sample;
+        void *slot;
+        sample = &profileSamples[(hash + i) & (EXH_PROFILE_SAMPLES - 1)];
+        slot = __atomic_load_n(&sample->mem, __ATOMIC_RELAXED);
+        if((slot == NULL || slot == EXH_PROFILE_TOMBSTONE) &&
+            __atomic_compare_exchange_n(
+                &sample->mem, &slot, mem, 0, __ATOMIC_ACQUIRE,
+                __ATOMIC_RELAXED)
+        ){
+            sample->site = site;
+            sample->allocs = allocs;
+            sample->bytes = bytes;
+            __atomic_add_fetch(&profileLive, 1, __ATOMIC_RELEASE);
+            return;
+        }
+    }
+    // no room to track the block, it stays live for ever in the report
+    __atomic_add_fetch(&profileDropped, 1, __ATOMIC_RELAXED);
 }
 
 // -----------------------------------------------------------------
-// exhrestore_handlers() :: restore signal/trap handlers if needed
+// exhprof_find() :: the live sample of a block, NULL when not sampled
 // -----------------------------------------------------------------
-static int exhresore_handlers(Context *context){
-    int restored = 0;
-    EXHANDLER_THREAD_MUTEX_FUNC(1);
-    if(EXHANDLER_MULTI_THREADING && EXHANDLER_SHARE && --numThreadsTry == 0){
-        signal(SIGABRT, shared_abort_handlerfn);
-        signal(SIGFPE, shared_fpe_handlerfn);
-        signal(SIGILL, shared_ill_handlerfn);
-        signal(SIGSEGV, shared_segv_handlerfn);
-#ifdef SIGBUS
-        signal(SIGBUS, shared_bus_handlerfn);
-#endif
-        restored = 1;
-    }else if(!EXHANDLER_MULTI_THREADING || !EXHANDLER_SHARE){
-        signal(SIGABRT, context->aborthandler);
-        signal(SIGFPE, context->fpehandler);
-        signal(SIGILL, context->illhandler);
-        signal(SIGSEGV, context->segvhandler);
-#ifdef SIGBUS
-        signal(SIGBUS, context->bushandler);
-#endif
-        restored = 1;
+static ProfileSample* exhprof_find(void *mem){
+    unsigned hash;
+    if(mem == NULL || __atomic_load_n(&profileLive, __ATOMIC_ACQUIRE) == 0){
+        return NULL;
+    }
+    hash = (unsigned)((uintptr_t)mem >> 4) * 40503u;
+    for(int i=0; i < EXH_PROFILE_PROBE; i++){
+        ProfileSample *sample;
+        void *slot;
+        sample = &profileSamples[(hash + i) & (EXH_PROFILE_SAMPLES - 1)];
+        slot = __atomic_load_n(&sample->mem, __ATOMIC_ACQUIRE);
+        if(slot == NULL){ return NULL; }
+        if(slot == mem){ return sample; }
     }
-    EXHANDLER_THREAD_MUTEX_FUNC(0);
 
-    return restored;
+    return NULL;
 }
 
-// -- 42
-void exhthread_cleanup(int tid){
-#if EXHANDLER_MULTI_THREADING
-    exh_validate(tid != EXHANDLER_ID_FUNC(), EXH_NOTHING);
-    if(tid == -1){
+// -----------------------------------------------------------------
+// exhprof_drop() :: remove a sample from the live ones
+// -----------------------------------------------------------------
+static void exhprof_drop(ProfileSample *sample){
+    if(sample == NULL){ return; }
+    __atomic_sub_fetch(
+        &sample->site->liveallocs, sample->allocs, __ATOMIC_RELAXED
+    );
+    __atomic_sub_fetch(
+        &sample->site->livebytes, sample->bytes, __ATOMIC_RELAXED
+    );
+    __atomic_sub_fetch(&profileLive, 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&sample->mem, EXH_PROFILE_TOMBSTONE, __ATOMIC_RELEASE);
+}
+
+// -----------------------------------------------------------------
+// exhprof_forget() :: remove a freed block from the live samples
+// -----------------------------------------------------------------
+static void exhprof_forget(void *mem){
+    exhprof_drop(exhprof_find(mem));
+}
+
+// -----------------------------------------------------------------
+// exhprof_compare() :: order merged sites by live, then total bytes
+// -----------------------------------------------------------------
+static int exhprof_compare(const void *a, const void *b){
+    const ProfileSite *x = a, *y = b;
+    if(x->livebytes != y->livebytes){
+        return x->livebytes < y->livebytes ? 1 : -1;
+    }
+    if(x->bytes != y->bytes){ return x->bytes < y->bytes ? 1 : -1; }
+    return 0;
+}
+
+// -----------------------------------------------------------------
+// exhprof_dump_handler() :: atexit() callback
+// -----------------------------------------------------------------
+static void exhprof_dump_handler(void){
+    FILE *fileptr = NULL;
+    if(profileDumpFile != NULL){
+        fileptr = fopen(profileDumpFile, "w");
+    }
+    exhprof_dump(fileptr);
+    if(fileptr != NULL){ fclose(fileptr); }
+}
+#endif /* EXHANDLER_HEAP_PROFILE */
+
+// -- 55
+int exhprof_start(size_t interval){
+#ifdef EXHANDLER_HEAP_PROFILE
+    profileInterval = interval ? interval : EXH_PROFILE_INTERVAL;
+    return 1;
+#else
+    return 0;
+#endif
+}
+
+// -- 56
+void exhprof_stop(void){
+#ifdef EXHANDLER_HEAP_PROFILE
+    profileInterval = 0;
+#endif
+}
+
+// -- 57
+void exhprof_dump(FILE *fileptr){
+#ifdef EXHANDLER_HEAP_PROFILE
+    ProfileSite *merged;
+    ProfileTable *table;
+    int len = 0;
+    size_t livebytes = 0, bytes = 0;
+
+    if(fileptr == NULL){ fileptr = stderr; }
+    table = __atomic_load_n(&profileTables, __ATOMIC_ACQUIRE);
+    for(ProfileTable *t=table; t != NULL; t = t->next){ len++; }
+    merged = calloc((size_t)len * EXH_PROFILE_SITES + 1, sizeof(ProfileSite));
+    if(merged == NULL){ return; }
+
+    len = 0;
+    for(; table != NULL; table = table->next){
+        for(int i=0; i < EXH_PROFILE_SITES; i++){
+            ProfileSite *site = &table->sites[i];
+            char *filename;
+            int j;
+            filename = __atomic_load_n(&site->filename, __ATOMIC_ACQUIRE);
+            if(filename == NULL){ continue; }
+            for(j=0; j < len; j++){
+                if(merged[j].lineno == site->lineno &&
+                    strcmp(merged[j].filename, filename) == 0){ break; }
+            }
+            if(j == len){
+                merged[len].filename = filename;
+                merged[len++].lineno = site->lineno;
+            }
+            merged[j].allocs += site->allocs;
+            merged[j].bytes += site->bytes;
+            merged[j].liveallocs += site->liveallocs;
+            merged[j].livebytes += site->livebytes;
+        }
+    }
+    qsort(merged, len, sizeof(ProfileSite), exhprof_compare);
+
+    fprintf(
+        fileptr, "exhandler heap profile (sampling interval %zu bytes, "
+        "%zu samples dropped)\n", profileInterval, profileDropped
+    );
+    fprintf(
+        fileptr, "%14s %12s %14s %12s  %s\n",
+        "live bytes", "live allocs", "total bytes", "allocs", "site"
+    );
+    for(int i=0; i < len; i++){
+        fprintf(
+            fileptr, "%14zu %12zu %14zu %12zu  %s:%d\n",
+            merged[i].livebytes, merged[i].liveallocs, merged[i].bytes,
+            merged[i].allocs, merged[i].filename, merged[i].lineno
+        );
+        livebytes += merged[i].livebytes;
+        bytes += merged[i].bytes;
+    }
+    fprintf(fileptr, "%14zu %12s %14zu %12s  total\n", livebytes, "", bytes, "");
+    free(merged);
+#endif
+}
+
+// -- 58
+void exhprof_dump_at_exit(char *filename){
+#ifdef EXHANDLER_HEAP_PROFILE
+    static int registered;
+    profileDumpFile = filename;
+    if(!registered++){ atexit(exhprof_dump_handler); }
+#endif
+}
+
+// ------------------------------------------------------------------
+// Size-class pool :: per thread free lists for small allocations
+// ------------------------------------------------------------------
+#define EXH_POOL_GRANULE    16
+#define EXH_POOL_CLASSES    (EXH_POOL_MAX_SIZE / EXH_POOL_GRANULE)
+
+typedef union PoolHeader{
+    size_t sizeclass;       // EXH_POOL_CLASSES ==> block from malloc()
+    long double align;
+} PoolHeader;
+
+typedef struct PoolBlock PoolBlock;
+struct PoolBlock{
+    PoolBlock *next;
+};
+
+typedef struct Pool{
+    PoolBlock *freelist[EXH_POOL_CLASSES];
+    char *cursor;
+    char *limit;
+} Pool;
+
+static EXHANDLER_THREAD_LOCAL Pool pool;
+
+// -----------------------------------------------------------------
+// exhmem_pool_carve() :: cut a new block of a size class from a chunk
+// -----------------------------------------------------------------
+static PoolHeader* exhmem_pool_carve(size_t sizeclass){
+    size_t size = sizeof(PoolHeader) + (sizeclass + 1) * EXH_POOL_GRANULE;
+    PoolHeader *header;
+    if(pool.cursor == NULL || (size_t)(pool.limit - pool.cursor) < size){
+        // the tail of the previous chunk is dropped, at most one block
+        if((pool.cursor = malloc(EXH_POOL_CHUNK_SIZE)) == NULL){
+            exhmem_release_reserve();
+            if((pool.cursor = malloc(EXH_POOL_CHUNK_SIZE)) == NULL){
+                pool.limit = NULL;
+                return NULL;
+            }
+        }
+        pool.limit = pool.cursor + EXH_POOL_CHUNK_SIZE;
+    }
+    header = (PoolHeader*)pool.cursor;
+    pool.cursor += size;
+
+    return header;
+}
+
+// -- 63
+void* exhmem_pool_alloc(
+    Context *cptr, size_t size, char *filename, int lineno
+){
+    PoolHeader *header;
+    size_t sizeclass;
+
+    EXH_BUSY_BEGIN(threadContext);
+    if(size == 0 || size > EXH_POOL_MAX_SIZE){
+        sizeclass = EXH_POOL_CLASSES;
+        header = NULL;
+        if(size <= SIZE_MAX - sizeof(PoolHeader)){
+            header = malloc(sizeof(PoolHeader) + size);
+        }
+    }else{
+        sizeclass = (size - 1) / EXH_POOL_GRANULE;
+        if(pool.freelist[sizeclass] != NULL){
+            header = (PoolHeader*)pool.freelist[sizeclass];
+            pool.freelist[sizeclass] = pool.freelist[sizeclass]->next;
+        }else{
+            header = exhmem_pool_carve(sizeclass);
+        }
+    }
+    if(header == NULL){
+        exhmem_release_reserve();
+        EXH_BUSY_END(threadContext);
+        exhthrow(cptr, OutOfMemoryError, NULL, filename, lineno);
+        return NULL;
+    }
+    header->sizeclass = sizeclass;
+    exhprof_record(header + 1, size, filename, lineno);
+    EXH_BUSY_END(threadContext);
+
+    return header + 1;
+}
+
+// -- 64
+void exhmem_pool_free(Context *cptr, void *mem){
+    PoolHeader *header;
+    PoolBlock *block;
+    size_t sizeclass;
+    if(mem == NULL){ return; }
+    EXH_BUSY_BEGIN(threadContext);
+    exhprof_forget(mem);
+    header = (PoolHeader*)mem - 1;
+    if((sizeclass = header->sizeclass) == EXH_POOL_CLASSES){
+        free(header);
+    }else{
+        assert(sizeclass < EXH_POOL_CLASSES);
+        block = (PoolBlock*)header;
+        block->next = pool.freelist[sizeclass];
+        pool.freelist[sizeclass] = block;
+    }
+    EXH_BUSY_END(threadContext);
+}
+
+// ------------------------------------------------------------------
+// Exception statistics :: per thread throw/catch/lost counters
+// ------------------------------------------------------------------
+#ifdef EXHANDLER_STATS
+typedef struct StatsTable StatsTable;
+struct StatsTable{
+    StatsTable *next;
+    ExceptionStats stats;
+};
+
+static StatsTable *volatile statsTables;
+static EXHANDLER_THREAD_LOCAL StatsTable *statsTable;
+
+// single writer per table: a relaxed store is enough, no locked add
+#define EXH_STATS_ADD(counter, n)    \
+    __atomic_store_n(&(counter), (counter) + (n), __ATOMIC_RELAXED)
+
+// -----------------------------------------------------------------
+// exhstats_get_table() :: calling thread's table, published on first use
+// -----------------------------------------------------------------
+static ExceptionStats* exhstats_get_table(void){
+    StatsTable *table = statsTable;
+    if(table == NULL){
+        if((table = calloc(1, sizeof(StatsTable))) == NULL){ return NULL; }
+        do{
+            table->next = statsTables;
+        }while(!__atomic_compare_exchange_n(
+            &statsTables, &table->next, table, 0,
+            __ATOMIC_RELEASE, __ATOMIC_RELAXED
+        ));
+        statsTable = table;
+    }
+
+    return &table->stats;
+}
+
+// -----------------------------------------------------------------
+// exhstats_get_class() :: find or claim the entry of an exception class
+// -----------------------------------------------------------------
+static ClassStats* exhstats_get_class(ExceptionStats *stats, ObjectRef class){
+    unsigned hash = (unsigned)((uintptr_t)class >> 4) * 40503u;
+    for(int i=0; i < EXH_STATS_CLASSES; i++){
+        ClassStats *entry;
+        entry = &stats->classes[(hash + i) & (EXH_STATS_CLASSES - 1)];
+        if(entry->class == class){ return entry; }
+        if(entry->class == NULL){
+            __atomic_store_n(&entry->class, class, __ATOMIC_RELEASE);
+            return entry;
+        }
+    }
+    EXH_STATS_ADD(stats->overflow, 1);
+
+    return NULL;
+}
+
+// -----------------------------------------------------------------
+// exhstats_get_site() :: find or claim the entry of a class at a site
+// -----------------------------------------------------------------
+static SiteStats* exhstats_get_site(
+    ExceptionStats *stats, ObjectRef class, char *filename, int lineno,
+    int caught
+){
+    unsigned hash = ((unsigned)((uintptr_t)class >> 4) ^
+        (unsigned)((uintptr_t)filename >> 3)) * 40503u + lineno * 2 + caught;
+    for(int i=0; i < EXH_STATS_SITES; i++){
+        SiteStats *entry;
+        entry = &stats->sites[(hash + i) & (EXH_STATS_SITES - 1)];
+        if(entry->class == class && entry->filename == filename &&
+            entry->lineno == lineno && entry->caught == caught){
+            return entry;
+        }
+        if(entry->class == NULL){
+            entry->filename = filename;
+            entry->lineno = lineno;
+            entry->caught = caught;
+            __atomic_store_n(&entry->class, class, __ATOMIC_RELEASE);
+            return entry;
+        }
+    }
+    EXH_STATS_ADD(stats->overflow, 1);
+
+    return NULL;
+}
+
+// -----------------------------------------------------------------
+// exhstats_throw() :: count a thrown exception
+// -----------------------------------------------------------------
+static void exhstats_throw(
+    ObjectRef class, char *filename, int lineno, int depth
+){
+    ExceptionStats *stats;
+    ClassStats *entry;
+    SiteStats *site;
+    if((stats = exhstats_get_table()) == NULL){ return; }
+    EXH_STATS_ADD(stats->throws, 1);
+    if(depth >= EXH_STATS_DEPTHS){ depth = EXH_STATS_DEPTHS - 1; }
+    EXH_STATS_ADD(stats->depth[depth], 1);
+    if((entry = exhstats_get_class(stats, class)) != NULL){
+        EXH_STATS_ADD(entry->throws, 1);
+    }
+    if((site = exhstats_get_site(stats, class, filename, lineno, 0)) != NULL){
+        EXH_STATS_ADD(site->count, 1);
+    }
+}
+
+// -----------------------------------------------------------------
+// exhstats_catch() :: count an exception caught by the 'try' at a site
+// -----------------------------------------------------------------
+static void exhstats_catch(ObjectRef class, char *tryfile, int trylineno){
+    ExceptionStats *stats;
+    ClassStats *entry;
+    SiteStats *site;
+    if((stats = exhstats_get_table()) == NULL){ return; }
+    EXH_STATS_ADD(stats->catches, 1);
+    if((entry = exhstats_get_class(stats, class)) != NULL){
+        EXH_STATS_ADD(entry->catches, 1);
+    }
+    site = exhstats_get_site(stats, class, tryfile, trylineno, 1);
+    if(site != NULL){
+        EXH_STATS_ADD(site->count, 1);
+    }
+}
+
+// -----------------------------------------------------------------
+// exhstats_lost() :: count an exception no 'try' caught
+// -----------------------------------------------------------------
+static void exhstats_lost(ObjectRef class){
+    ExceptionStats *stats;
+    ClassStats *entry;
+    if((stats = exhstats_get_table()) == NULL){ return; }
+    EXH_STATS_ADD(stats->lost, 1);
+    if((entry = exhstats_get_class(stats, class)) != NULL){
+        EXH_STATS_ADD(entry->lost, 1);
+    }
+}
+
+// -----------------------------------------------------------------
+// exhstats_causes() :: count the classes of a thrown cause chain
+// -----------------------------------------------------------------
+static void exhstats_causes(ExceptionCause *causes, int ncauses){
+    ExceptionStats *stats;
+    ClassStats *entry;
+    if(ncauses == 0 || (stats = exhstats_get_table()) == NULL){ return; }
+    for(int i=0; i < ncauses; i++){
+        if((entry = exhstats_get_class(stats, causes[i].class)) != NULL){
+            EXH_STATS_ADD(entry->causes, 1);
+        }
+    }
+}
+
+// -----------------------------------------------------------------
+// exhstats_compare_*() :: busiest entries first
+// -----------------------------------------------------------------
+static int exhstats_compare_class(const void *a, const void *b){
+    const ClassStats *x = a, *y = b;
+    size_t nx = x->throws + x->lost + x->causes;
+    size_t ny = y->throws + y->lost + y->causes;
+    return nx == ny ? 0 : (nx < ny ? 1 : -1);
+}
+
+static int exhstats_compare_site(const void *a, const void *b){
+    const SiteStats *x = a, *y = b;
+    return x->count == y->count ? 0 : (x->count < y->count ? 1 : -1);
+}
+#else
+#define exhstats_throw(class, filename, lineno, depth)
+#define exhstats_catch(class, tryfile, trylineno)
+#define exhstats_lost(class)
+#define exhstats_causes(causes, ncauses)
+#endif /* EXHANDLER_STATS */
+
+// -- 65
+void exhstats_snapshot(ExceptionStats *stats){
+    memset(stats, 0, sizeof(ExceptionStats));
+#ifdef EXHANDLER_STATS
+    StatsTable *table = __atomic_load_n(&statsTables, __ATOMIC_ACQUIRE);
+    for(; table != NULL; table = table->next){
+        ExceptionStats *other = &table->stats;
+        // entries are claimed by publishing 'class' last
+        stats->throws += __atomic_load_n(&other->throws, __ATOMIC_RELAXED);
+        stats->catches += __atomic_load_n(&other->catches, __ATOMIC_RELAXED);
+        stats->lost += __atomic_load_n(&other->lost, __ATOMIC_RELAXED);
+        stats->overflow += __atomic_load_n(&other->overflow,__ATOMIC_RELAXED);
+        for(int i=0; i < EXH_STATS_DEPTHS; i++){
+            stats->depth[i] += __atomic_load_n(
+                &other->depth[i], __ATOMIC_RELAXED
+            );
+        }
+        for(int i=0; i < EXH_STATS_CLASSES; i++){
+            ClassStats entry, *into;
+            entry.class = __atomic_load_n(
+                &other->classes[i].class, __ATOMIC_ACQUIRE
+            );
+            if(entry.class == NULL){ continue; }
+            if((into = exhstats_get_class(stats, entry.class)) == NULL){
+                continue;
+            }
+            into->throws += other->classes[i].throws;
+            into->catches += other->classes[i].catches;
+            into->lost += other->classes[i].lost;
+            into->causes += other->classes[i].causes;
+        }
+        for(int i=0; i < EXH_STATS_SITES; i++){
+            SiteStats *entry = &other->sites[i], *into;
+            ObjectRef class;
+            class = __atomic_load_n(&entry->class, __ATOMIC_ACQUIRE);
+            if(class == NULL){ continue; }
+            into = exhstats_get_site(
+                stats, class, entry->filename, entry->lineno, entry->caught
+            );
+            if(into != NULL){ into->count += entry->count; }
+        }
+    }
+    stats->nclasses = stats->nsites = 0;
+    for(int i=0; i < EXH_STATS_CLASSES; i++){
+        stats->nclasses += stats->classes[i].class != NULL;
+    }
+    for(int i=0; i < EXH_STATS_SITES; i++){
+        stats->nsites += stats->sites[i].class != NULL;
+    }
+#endif
+}
+
+// -- 66
+void exhstats_merge(ExceptionStats *stats, ExceptionStats *other){
+#ifdef EXHANDLER_STATS
+    stats->throws += other->throws;
+    stats->catches += other->catches;
+    stats->lost += other->lost;
+    stats->overflow += other->overflow;
+    for(int i=0; i < EXH_STATS_DEPTHS; i++){
+        stats->depth[i] += other->depth[i];
+    }
+    for(int i=0; i < EXH_STATS_CLASSES; i++){
+        ClassStats *entry = &other->classes[i], *into;
+        if(entry->class == NULL){ continue; }
+        if((into = exhstats_get_class(stats, entry->class)) == NULL){
+            continue;
+        }
+        stats->nclasses +=
+            into->throws + into->catches + into->lost + into->causes == 0;
+        into->throws += entry->throws;
+        into->catches += entry->catches;
+        into->lost += entry->lost;
+        into->causes += entry->causes;
+    }
+    for(int i=0; i < EXH_STATS_SITES; i++){
+        SiteStats *entry = &other->sites[i], *into;
+        if(entry->class == NULL){ continue; }
+        into = exhstats_get_site(
+            stats, entry->class, entry->filename, entry->lineno, entry->caught
+        );
+        if(into != NULL){
+            stats->nsites += into->count == 0;
+            into->count += entry->count;
+        }
+    }
+#endif
+}
+
+// -- 67
+void exhstats_print(FILE *fileptr, ExceptionStats *stats){
+#ifdef EXHANDLER_STATS
+    ClassStats classes[EXH_STATS_CLASSES];
+    SiteStats sites[EXH_STATS_SITES];
+
+    if(fileptr == NULL){ fileptr = stderr; }
+    memcpy(classes, stats->classes, sizeof(classes));
+    memcpy(sites, stats->sites, sizeof(sites));
+    qsort(classes, EXH_STATS_CLASSES, sizeof(ClassStats),
+        exhstats_compare_class);
+    qsort(sites, EXH_STATS_SITES, sizeof(SiteStats), exhstats_compare_site);
+
+    fprintf(
+        fileptr, "exceptions: %zu thrown, %zu caught, %zu lost "
+        "(%d entries overflowed)\n",
+        stats->throws, stats->catches, stats->lost, stats->overflow
+    );
+    fprintf(
+        fileptr, "%12s %12s %12s %12s  %s\n", "thrown", "caught", "lost",
+        "cause", "class"
+    );
+    for(int i=0; i < EXH_STATS_CLASSES && classes[i].class != NULL; i++){
+        fprintf(
+            fileptr, "%12zu %12zu %12zu %12zu  %s\n", classes[i].throws,
+            classes[i].catches, classes[i].lost, classes[i].causes,
+            classes[i].class->name
+        );
+    }
+    fprintf(fileptr, "%12s  %-6s %-24s %s\n", "count", "kind", "class", "site");
+    for(int i=0; i < EXH_STATS_SITES && sites[i].class != NULL; i++){
+        fprintf(
+            fileptr, "%12zu  %-6s %-24s %s:%d\n", sites[i].count,
+            sites[i].caught ? "catch" : "throw", sites[i].class->name,
+            sites[i].filename, sites[i].lineno
+        );
+    }
+    fprintf(fileptr, "%12s  %s\n", "throws", "try depth");
+    for(int i=0; i < EXH_STATS_DEPTHS; i++){
+        if(stats->depth[i] == 0){ continue; }
+        fprintf(
+            fileptr, "%12zu  %s%d\n", stats->depth[i],
+            i == EXH_STATS_DEPTHS - 1 ? ">=" : "", i
+        );
+    }
+#endif
+}
+
+// ------------------------------------------------------------------
+// Latency histograms :: per thread, per class throw to catch time
+// ------------------------------------------------------------------
+#ifdef EXHANDLER_TIMING
+typedef struct LatencyTable LatencyTable;
+struct LatencyTable{
+    LatencyTable *next;
+    LatencyHistogram hists[EXH_LATENCY_CLASSES];
+};
+
+static LatencyTable *volatile latencyTables;
+static EXHANDLER_THREAD_LOCAL LatencyTable *latencyTable;
+
+#define EXH_LATENCY_SET(field, value)    \
+    __atomic_store_n(&(field), (value), __ATOMIC_RELAXED)
+
+// -----------------------------------------------------------------
+// exhlatency_now() :: monotonic time stamp in nanoseconds
+// -----------------------------------------------------------------
+static unsigned long long exhlatency_now(void){
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+// -----------------------------------------------------------------
+// exhlatency_bucket() :: log-linear bucket index of a latency
+// -----------------------------------------------------------------
+static int exhlatency_bucket(unsigned long long ns){
+    int exponent, index;
+    if(ns < EXH_LATENCY_SUBBUCKETS){ return (int)ns; }
+    exponent = 63 - __builtin_clzll(ns);        // >= 4
+    index = (exponent - 3) * EXH_LATENCY_SUBBUCKETS +
+        (int)((ns >> (exponent - 4)) & (EXH_LATENCY_SUBBUCKETS - 1));
+
+    return index < EXH_LATENCY_BUCKETS ? index : EXH_LATENCY_BUCKETS - 1;
+}
+
+// -----------------------------------------------------------------
+// exhlatency_upper() :: largest latency falling in a bucket
+// -----------------------------------------------------------------
+static unsigned long long exhlatency_upper(int index){
+    int exponent, sub;
+    if(index < EXH_LATENCY_SUBBUCKETS){ return index; }
+    exponent = index / EXH_LATENCY_SUBBUCKETS + 3;
+    sub = index % EXH_LATENCY_SUBBUCKETS;
+    return ((unsigned long long)(EXH_LATENCY_SUBBUCKETS + sub + 1)
+        << (exponent - 4)) - 1;
+}
+
+// -----------------------------------------------------------------
+// exhlatency_record() :: account the latency of a caught/lost exception
+// -----------------------------------------------------------------
+static void exhlatency_record(
+    ObjectRef class, unsigned long long throwtime, int lost
+){
+    LatencyTable *table = latencyTable;
+    LatencyHistogram *hist = NULL;
+    unsigned long long elapsed;
+    unsigned hash;
+    int index;
+
+    if(throwtime == 0){ return; }
+    elapsed = exhlatency_now() - throwtime;
+    if(table == NULL){
+        if((table = calloc(1, sizeof(LatencyTable))) == NULL){ return; }
+        do{
+            table->next = latencyTables;
+        }while(!__atomic_compare_exchange_n(
+            &latencyTables, &table->next, table, 0,
+            __ATOMIC_RELEASE, __ATOMIC_RELAXED
+        ));
+        latencyTable = table;
+    }
+    hash = (unsigned)((uintptr_t)class >> 4) * 40503u;
+    for(int i=0; i < EXH_LATENCY_CLASSES; i++){
+        hist = &table->hists[(hash + i) & (EXH_LATENCY_CLASSES - 1)];
+        if(hist->class == class){ break; }
+        if(hist->class == NULL){
+            hist->min = elapsed;
+            __atomic_store_n(&hist->class, class, __ATOMIC_RELEASE);
+            break;
+        }
+        hist = NULL;
+    }
+    if(hist == NULL){ return; }
+
+    // single writer per table, see EXH_STATS_ADD
+    EXH_LATENCY_SET(hist->count, hist->count + 1);
+    EXH_LATENCY_SET(hist->lost, hist->lost + (lost != 0));
+    EXH_LATENCY_SET(hist->sum, hist->sum + elapsed);
+    if(elapsed < hist->min){ EXH_LATENCY_SET(hist->min, elapsed); }
+    if(elapsed > hist->max){ EXH_LATENCY_SET(hist->max, elapsed); }
+    index = exhlatency_bucket(elapsed);
+    EXH_LATENCY_SET(hist->buckets[index], hist->buckets[index] + 1);
+}
+
+#define exhlatency_stamp()      exhlatency_now()
+#else
+#define exhlatency_stamp()      0ULL
+#define exhlatency_record(class, throwtime, lost)  ((void)(throwtime))
+#endif /* EXHANDLER_TIMING */
+
+// -- 68
+void exhlatency_snapshot(ObjectRef class, LatencyHistogram *hist){
+    memset(hist, 0, sizeof(LatencyHistogram));
+    hist->class = class;
+#ifdef EXHANDLER_TIMING
+    LatencyTable *table = __atomic_load_n(&latencyTables, __ATOMIC_ACQUIRE);
+    for(; table != NULL; table = table->next){
+        for(int i=0; i < EXH_LATENCY_CLASSES; i++){
+            LatencyHistogram *other = &table->hists[i];
+            ObjectRef oclass;
+            size_t count;
+            oclass = __atomic_load_n(&other->class, __ATOMIC_ACQUIRE);
+            if(oclass == NULL || (class != NULL && oclass != class)){
+                continue;
+            }
+            if((count = other->count) == 0){ continue; }
+            if(hist->count == 0 || other->min < hist->min){
+                hist->min = other->min;
+            }
+            if(other->max > hist->max){ hist->max = other->max; }
+            hist->count += count;
+            hist->lost += other->lost;
+            hist->sum += other->sum;
+            for(int j=0; j < EXH_LATENCY_BUCKETS; j++){
+                hist->buckets[j] += other->buckets[j];
+            }
+        }
+    }
+#endif
+}
+
+// -- 69
+unsigned long long exhlatency_percentile(
+    LatencyHistogram *hist, double percentile
+){
+#ifdef EXHANDLER_TIMING
+    size_t total = 0, rank;
+    for(int i=0; i < EXH_LATENCY_BUCKETS; i++){ total += hist->buckets[i]; }
+    if(total == 0){ return 0; }
+    rank = (size_t)(percentile / 100.0 * total + 0.5);
+    if(rank == 0){ rank = 1; }
+    for(int i=0; i < EXH_LATENCY_BUCKETS; i++){
+        if(hist->buckets[i] >= rank){
+            unsigned long long upper = exhlatency_upper(i);
+            return upper < hist->max ? upper : hist->max;
+        }
+        rank -= hist->buckets[i];
+    }
+    return hist->max;
+#else
+    return 0;
+#endif
+}
+
+// -- 70
+void exhlatency_print(FILE *fileptr){
+#ifdef EXHANDLER_TIMING
+    ObjectRef classes[EXH_LATENCY_CLASSES * 4];
+    LatencyHistogram *hist;
+    LatencyTable *table;
+    int len = 0;
+
+    if(fileptr == NULL){ fileptr = stderr; }
+    if((hist = malloc(sizeof(LatencyHistogram))) == NULL){ return; }
+    table = __atomic_load_n(&latencyTables, __ATOMIC_ACQUIRE);
+    for(; table != NULL; table = table->next){
+        for(int i=0; i < EXH_LATENCY_CLASSES; i++){
+            ObjectRef class;
+            int j;
+            class = __atomic_load_n(&table->hists[i].class, __ATOMIC_ACQUIRE);
+            if(class == NULL){ continue; }
+            for(j=0; j < len && classes[j] != class; j++){}
+            if(j == len && len < EXH_LATENCY_CLASSES * 4){
+                classes[len++] = class;
+            }
+        }
+    }
+
+    fprintf(
+        fileptr, "%-24s %10s %8s %10s %10s %10s %10s %10s  (ns)\n",
+        "class", "count", "lost", "p50", "p90", "p99", "p99.9", "max"
+    );
+    for(int i=0; i < len; i++){
+        exhlatency_snapshot(classes[i], hist);
+        fprintf(
+            fileptr, "%-24s %10zu %8zu %10llu %10llu %10llu %10llu %10llu\n",
+            classes[i]->name, hist->count, hist->lost,
+            exhlatency_percentile(hist, 50.0),
+            exhlatency_percentile(hist, 90.0),
+            exhlatency_percentile(hist, 99.0),
+            exhlatency_percentile(hist, 99.9), hist->max
+        );
+    }
+    free(hist);
+#endif
+}
+
+// ------------------------------------------------------------------
+// Event ring :: per thread lock-free ring of binary exception events
+// ------------------------------------------------------------------
+#ifdef EXHANDLER_EVENTS
+#define EXH_EVENT_STRINGS       4096    /* flusher string ids, power of 2 */
+#define EXH_EVENT_BUFFER_SIZE   (64 * 1024)
+
+typedef struct Event{
+    unsigned long long timestamp;
+    ObjectRef class;
+    char *filename;
+    char *detail;
+    int lineno;
+    short kind;
+    short depth;
+} Event;
+
+typedef struct EventRing EventRing;
+struct EventRing{
+    EventRing *next;
+    int thread;
+    volatile unsigned head;         // written by the owner thread only
+    volatile unsigned tail;         // written by the drain only
+    Event events[EXH_EVENT_RING_SIZE];
+};
+
+typedef struct EventString{
+    char *string;
+    unsigned id;
+} EventString;
+
+static volatile int eventsEnabled;
+static volatile int eventsFd = -1;
+static volatile int eventsDraining;
+static volatile size_t eventsDropped;
+static EventRing *volatile eventRings;
+static EXHANDLER_THREAD_LOCAL EventRing *eventRing;
+static EventString eventStrings[EXH_EVENT_STRINGS];
+static unsigned eventNextId = 1;
+#ifdef EXHANDLER_USE_PTHREAD
+static pthread_t eventFlusher;
+static volatile int eventFlusherRunning;
+static int eventFlusherInterval;
+#endif
+
+// -----------------------------------------------------------------
+// exhevent_record() :: push an event on the calling thread's ring
+// -----------------------------------------------------------------
+static int exhevent_record(
+    int kind, ObjectRef class, char *filename, int lineno, char *detail,
+    int depth
+){
+    EventRing *ring = eventRing;
+    struct timespec now;
+    unsigned head;
+    Event *event;
+
+    if(!eventsEnabled){ return 0; }
+    if(ring == NULL){
+        if((ring = calloc(1, sizeof(EventRing))) == NULL){ return 0; }
+        ring->thread = EXHANDLER_THREAD_ID_FUNC();
+        do{
+            ring->next = eventRings;
+        }while(!__atomic_compare_exchange_n(
+            &eventRings, &ring->next, ring, 0,
+            __ATOMIC_RELEASE, __ATOMIC_RELAXED
+        ));
+        eventRing = ring;
+    }
+    head = ring->head;
+    if(head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) >=
+        EXH_EVENT_RING_SIZE){
+        __atomic_add_fetch(&eventsDropped, 1, __ATOMIC_RELAXED);
+        return 1;
+    }
+    clock_gettime(CLOCK_REALTIME, &now);
+    event = &ring->events[head & (EXH_EVENT_RING_SIZE - 1)];
+    event->timestamp = now.tv_sec * 1000000000ULL + now.tv_nsec;
+    event->class = class;
+    event->filename = filename;
+    event->detail = detail;
+    event->lineno = lineno;
+    event->kind = kind;
+    event->depth = depth;
+    __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+
+    return 1;
+}
+
+// -----------------------------------------------------------------
+// exhevent_flush() :: write the drain buffer, retrying short writes
+// -----------------------------------------------------------------
+static int exhevent_flush(char *buffer, size_t *len){
+    size_t done = 0;
+    while(done < *len){
+        ssize_t n = write(eventsFd, buffer + done, *len - done);
+        if(n < 0){
+            if(errno == EINTR){ continue; }
+            return -1;
+        }
+        done += n;
+    }
+    *len = 0;
+
+    return 0;
+}
+
+// -----------------------------------------------------------------
+// exhevent_string() :: id of a string, define it in the stream if new
+// -----------------------------------------------------------------
+static unsigned exhevent_string(char *string, char *buffer, size_t *len){
+    StringRecord record = {EXH_RECORD_STRING, {0}, 0, 0};
+    unsigned hash;
+    EventString *entry = NULL;
+
+    if(string == NULL){ return 0; }
+    hash = (unsigned)((uintptr_t)string >> 3) * 40503u;
+    for(int i=0; i < EXH_EVENT_STRINGS; i++){
+        entry = &eventStrings[(hash + i) & (EXH_EVENT_STRINGS - 1)];
+        if(entry->string == string){ return entry->id; }
+        if(entry->string == NULL){ break; }
+        entry = NULL;
+    }
+
+    record.id = eventNextId++;
+    record.len = strlen(string);
+    if(record.len > EXH_EVENT_BUFFER_SIZE / 2){
+        record.len = EXH_EVENT_BUFFER_SIZE / 2;
+    }
+    if(*len + sizeof(record) + record.len > EXH_EVENT_BUFFER_SIZE &&
+        exhevent_flush(buffer, len) < 0){
+        return 0;
+    }
+    memcpy(buffer + *len, &record, sizeof(record));
+    memcpy(buffer + *len + sizeof(record), string, record.len);
+    *len += sizeof(record) + record.len;
+    // a full table only costs redefinitions of the string
+    if(entry != NULL){
+        entry->string = string;
+        entry->id = record.id;
+    }
+
+    return record.id;
+}
+
+#ifdef EXHANDLER_USE_PTHREAD
+// -----------------------------------------------------------------
+// exhevent_flusher() :: background drain loop
+// -----------------------------------------------------------------
+static void* exhevent_flusher(void *arg){
+    while(eventFlusherRunning){
+        exhevent_drain();
+        usleep(eventFlusherInterval * 1000);
+    }
+    return arg;
+}
+#endif
+#endif /* EXHANDLER_EVENTS */
+
+// -- 71
+int exhevent_open(int fd){
+#ifdef EXHANDLER_EVENTS
+    char magic[8] = EXH_EVENT_MAGIC;
+    size_t len = sizeof(magic);
+    if(fd < 0){ return 0; }
+    // a new stream defines its strings again
+    memset(eventStrings, 0, sizeof(eventStrings));
+    eventNextId = 1;
+    eventsFd = fd;
+    if(exhevent_flush(magic, &len) < 0){ return 0; }
+    eventsEnabled = 1;
+    return 1;
+#else
+    return 0;
+#endif
+}
+
+// -- 72
+int exhevent_drain(void){
+#ifdef EXHANDLER_EVENTS
+    char *buffer;
+    size_t len = 0;
+    int count = 0;
+    EventRing *ring;
+
+    if(eventsFd < 0 ||
+        __atomic_exchange_n(&eventsDraining, 1, __ATOMIC_ACQUIRE)){
+        return 0;
+    }
+    if((buffer = malloc(EXH_EVENT_BUFFER_SIZE)) == NULL){
+        __atomic_store_n(&eventsDraining, 0, __ATOMIC_RELEASE);
+        return -1;
+    }
+    ring = __atomic_load_n(&eventRings, __ATOMIC_ACQUIRE);
+    for(; ring != NULL && count >= 0; ring = ring->next){
+        unsigned tail = ring->tail;
+        unsigned head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+        for(; tail != head; tail++){
+            Event *event = &ring->events[tail & (EXH_EVENT_RING_SIZE - 1)];
+            EventRecord record;
+            memset(&record, 0, sizeof(record));
+            record.type = EXH_RECORD_EVENT;
+            record.kind = event->kind;
+            record.classid = exhevent_string(event->class->name, buffer, &len);
+            record.fileid = exhevent_string(event->filename, buffer, &len);
+            record.detailid = exhevent_string(event->detail, buffer, &len);
+            record.lineno = event->lineno;
+            record.depth = event->depth;
+            record.thread = ring->thread;
+            record.timestamp = event->timestamp;
+            if(len + sizeof(record) > EXH_EVENT_BUFFER_SIZE &&
+                exhevent_flush(buffer, &len) < 0){
+                count = -1;
+                break;
+            }
+            memcpy(buffer + len, &record, sizeof(record));
+            len += sizeof(record);
+            count++;
+        }
+        __atomic_store_n(&ring->tail, tail, __ATOMIC_RELEASE);
+    }
+    if(count >= 0 && exhevent_flush(buffer, &len) < 0){ count = -1; }
+    free(buffer);
+    __atomic_store_n(&eventsDraining, 0, __ATOMIC_RELEASE);
+
+    return count;
+#else
+    return 0;
+#endif
+}
+
+// -- 73
+int exhevent_start_flusher(int intervalms){
+#if defined(EXHANDLER_EVENTS) && defined(EXHANDLER_USE_PTHREAD)
+    if(eventFlusherRunning || eventsFd < 0){ return eventFlusherRunning; }
+    eventFlusherInterval = intervalms > 0 ? intervalms : 100;
+    eventFlusherRunning = 1;
+    if(pthread_create(&eventFlusher, NULL, exhevent_flusher, NULL) != 0){
+        eventFlusherRunning = 0;
+    }
+    return eventFlusherRunning;
+#else
+    return 0;
+#endif
+}
+
+// -- 74
+void exhevent_close(void){
+#ifdef EXHANDLER_EVENTS
+    eventsEnabled = 0;
+#ifdef EXHANDLER_USE_PTHREAD
+    if(eventFlusherRunning){
+        eventFlusherRunning = 0;
+        pthread_join(eventFlusher, NULL);
+    }
+#endif
+    exhevent_drain();
+    eventsFd = -1;
+#endif
+}
+
+// -- 75
+size_t exhevent_dropped(void){
+#ifdef EXHANDLER_EVENTS
+    return eventsDropped;
+#else
+    return 0;
+#endif
+}
+
+// ------------------------------------------------------------------
+// Flight recorder :: last throws and catches per thread, in a mapped file
+// ------------------------------------------------------------------
+#ifdef EXHANDLER_FLIGHT_RECORDER
+static FlightHeader *volatile flightHeader;
+static size_t flightSize;
+static unsigned flightGeneration;
+static EXHANDLER_THREAD_LOCAL FlightThread *flightThread;
+static EXHANDLER_THREAD_LOCAL unsigned flightThreadGeneration;
+static EXHANDLER_THREAD_LOCAL int flightFull;
+static EXHANDLER_THREAD_LOCAL void *faultAddress;
+static EXHANDLER_THREAD_LOCAL int faultSignal;
+
+// -----------------------------------------------------------------
+// exhflight_copy() :: copy the tail of a string into a fixed field
+// -----------------------------------------------------------------
+static void exhflight_copy(char *dst, const char *src, size_t size){
+    size_t len = 0;
+    if(src == NULL){ src = ""; }
+    while(src[len]){ len++; }
+    if(len >= size){
+        src += len - (size - 1);
+        len = size - 1;
+    }
+    for(size_t i=0; i < len; i++){ dst[i] = src[i]; }
+    dst[len] = '\0';
+}
+
+// -----------------------------------------------------------------
+// exhflight_record() :: store an event in the calling thread's slot
+// -----------------------------------------------------------------
+static void exhflight_record(
+    int kind, ObjectRef class, char *filename, int lineno, Context *context
+){
+    FlightHeader *header = flightHeader;
+    FlightThread *slot = flightThread;
+    FlightRecord *record;
+    struct timespec now;
+    int depth;
+
+    if(header == NULL){ return; }
+    if(flightThreadGeneration != flightGeneration){
+        flightThreadGeneration = flightGeneration;
+        flightThread = slot = NULL;
+        flightFull = 0;
+    }
+    if(flightFull){ return; }
+    if(slot == NULL){
+        unsigned index = __atomic_fetch_add(&header->used, 1, __ATOMIC_RELAXED);
+        if(index >= header->nthreads){
+            flightFull = 1;
+            return;
+        }
+        slot = (FlightThread*)((char*)(header + 1) + index * (
+            sizeof(FlightThread) + header->nevents * sizeof(FlightRecord)
+        ));
+        slot->thread = EXHANDLER_THREAD_ID_FUNC();
+        flightThread = slot;
+    }
+    record = (FlightRecord*)(slot + 1) + slot->next % header->nevents;
+    // no syscall on this path, clock_gettime() is served by the vDSO
+    clock_gettime(CLOCK_REALTIME, &now);
+    __atomic_store_n(&record->seq, 0, __ATOMIC_RELAXED);
+    __atomic_signal_fence(__ATOMIC_SEQ_CST);
+    record->timestamp = now.tv_sec * 1000000000ULL + now.tv_nsec;
+    record->kind = kind;
+    record->lineno = lineno;
+    record->address = 0;
+    record->signum = 0;
+    if(kind == EXH_EVENT_THROW && faultSignal){
+        record->address = (uintptr_t)faultAddress;
+        record->signum = faultSignal;
+        faultSignal = 0;
+    }
+    exhflight_copy(record->class, class->name, sizeof(record->class));
+    exhflight_copy(record->filename, filename, sizeof(record->filename));
+    depth = context && context->stack ? stack_len(context->stack) : 0;
+    record->depth = depth;
+    for(int i=0; i < EXH_FLIGHT_TRIES; i++){
+        FlightTry *site = &record->tries[i];
+        if(i < depth){
+            ExceptionType *except = stack_peek(context->stack, i + 1);
+            site->lineno = except->trylineno;
+            exhflight_copy(
+                site->filename, except->tryfile, sizeof(site->filename)
+            );
+        }else{
+            site->lineno = 0;
+            site->filename[0] = '\0';
+        }
+    }
+    __atomic_store_n(&record->seq, ++slot->next, __ATOMIC_RELEASE);
+}
+#endif /* EXHANDLER_FLIGHT_RECORDER */
+
+// -- 76
+int exhflight_open(const char *filename, int nthreads, int nevents){
+#ifdef EXHANDLER_FLIGHT_RECORDER
+    FlightHeader *header;
+    struct timespec now;
+    size_t size;
+    int fd;
+
+    if(flightHeader != NULL || nthreads <= 0 || nevents <= 0){ return 0; }
+    size = sizeof(FlightHeader) + (size_t)nthreads * (
+        sizeof(FlightThread) + (size_t)nevents * sizeof(FlightRecord)
+    );
+    if((fd = open(filename, O_RDWR | O_CREAT | O_TRUNC, 0644)) < 0){
+        return 0;
+    }
+    if(ftruncate(fd, size) < 0){
+        close(fd);
+        return 0;
+    }
+    header = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if(header == MAP_FAILED){ return 0; }
+
+    clock_gettime(CLOCK_REALTIME, &now);
+    header->nthreads = nthreads;
+    header->nevents = nevents;
+    header->recordsize = sizeof(FlightRecord);
+    header->pid = getpid();
+    header->starttime = now.tv_sec * 1000000000ULL + now.tv_nsec;
+    memcpy(header->magic, EXH_FLIGHT_MAGIC, sizeof(header->magic));
+    flightSize = size;
+    flightGeneration++;
+    __atomic_store_n(&flightHeader, header, __ATOMIC_RELEASE);
+
+    return 1;
+#else
+    return 0;
+#endif
+}
+
+// -- 77
+void exhflight_close(void){
+#ifdef EXHANDLER_FLIGHT_RECORDER
+    FlightHeader *header = flightHeader;
+    if(header == NULL){ return; }
+    flightHeader = NULL;
+    msync(header, flightSize, MS_ASYNC);
+    munmap(header, flightSize);
+#endif
+}
+
+// ------------------------------------------------------------------
+// Backtrace :: raw call frames at throw, symbolized when printed
+// ------------------------------------------------------------------
+#ifdef EXHANDLER_BACKTRACE
+#define EXH_SYMBOL_CACHE_SIZE   1024    /* power of 2 */
+
+typedef struct SymbolEntry{
+    void *pc;
+    char *symbol;
+} SymbolEntry;
+
+static SymbolEntry symbolCache[EXH_SYMBOL_CACHE_SIZE];
+
+// -----------------------------------------------------------------
+// exhbacktrace_capture() :: store the return addresses above exhthrow()
+// -----------------------------------------------------------------
+static __attribute__((noinline)) int exhbacktrace_capture(void **frames){
+#ifdef EXHANDLER_FRAME_POINTERS
+    // needs -fno-omit-frame-pointer, stops at the first foreign frame
+    void **frame = *(void***)__builtin_frame_address(0);
+    int nframes = 0;
+    while(frame != NULL && nframes < EXH_BACKTRACE_DEPTH){
+        void **next = frame[0];
+        if(frame[1] == NULL){ break; }
+        frames[nframes++] = frame[1];
+        if(next <= frame){ break; }
+        frame = next;
+    }
+    return nframes;
+#else
+    void *buffer[EXH_BACKTRACE_DEPTH + 2];
+    int nframes = backtrace(buffer, EXH_BACKTRACE_DEPTH + 2) - 2;
+    if(nframes <= 0){ return 0; }
+    memcpy(frames, buffer + 2, nframes * sizeof(void*));
+    return nframes;
+#endif
+}
+
+// -----------------------------------------------------------------
+// exhbacktrace_resolve() :: format a frame as "symbol+0xoff (module)"
+// -----------------------------------------------------------------
+static int exhbacktrace_resolve(void *pc, char *buffer, size_t size){
+    Dl_info info;
+    if(dladdr(pc, &info) == 0 || info.dli_fname == NULL){
+        return snprintf(buffer, size, "%p", pc);
+    }
+    if(info.dli_sname == NULL){
+        return snprintf(
+            buffer, size, "%s+0x%lx", info.dli_fname,
+            (unsigned long)((char*)pc - (char*)info.dli_fbase)
+        );
+    }
+    return snprintf(
+        buffer, size, "%s+0x%lx (%s)", info.dli_sname,
+        (unsigned long)((char*)pc - (char*)info.dli_saddr), info.dli_fname
+    );
+}
+
+// -----------------------------------------------------------------
+// exhbacktrace_symbol() :: cached symbol of a frame, NULL if unknown
+// -----------------------------------------------------------------
+static char* exhbacktrace_symbol(void *pc){
+    unsigned hash = (unsigned)((uintptr_t)pc >> 2) * 40503u;
+    SymbolEntry *entry = NULL;
+    char buffer[512];
+    char *symbol = NULL;
+
+    EXHANDLER_THREAD_MUTEX_FUNC(1);
+    for(int i=0; i < EXH_SYMBOL_CACHE_SIZE; i++){
+        entry = &symbolCache[(hash + i) & (EXH_SYMBOL_CACHE_SIZE - 1)];
+        if(entry->pc == pc || entry->pc == NULL){ break; }
+        entry = NULL;
+    }
+    if(entry != NULL && entry->pc == pc){
+        symbol = entry->symbol;
+    }else if(entry != NULL){
+        exhbacktrace_resolve(pc, buffer, sizeof(buffer));
+        if((symbol = strdup(buffer)) != NULL){
+            entry->symbol = symbol;
+            __atomic_store_n(&entry->pc, pc, __ATOMIC_RELEASE);
+        }
+    }
+    EXHANDLER_THREAD_MUTEX_FUNC(0);
+
+    return symbol;
+}
+
+// -----------------------------------------------------------------
+// exhbacktrace_cached() :: symbol of a frame if already resolved, no lock
+// -----------------------------------------------------------------
+static char* exhbacktrace_cached(void *pc){
+    unsigned hash = (unsigned)((uintptr_t)pc >> 2) * 40503u;
+    for(int i=0; i < EXH_SYMBOL_CACHE_SIZE; i++){
+        SymbolEntry *entry;
+        void *key;
+        entry = &symbolCache[(hash + i) & (EXH_SYMBOL_CACHE_SIZE - 1)];
+        key = __atomic_load_n(&entry->pc, __ATOMIC_ACQUIRE);
+        if(key == pc){ return entry->symbol; }
+        if(key == NULL){ break; }
+    }
+
+    return NULL;
+}
+#else
+#define exhbacktrace_capture(frames)    0
+#endif /* EXHANDLER_BACKTRACE */
+
+// ------------------------------------------------------------------
+// Signal-safe output :: format into a stack buffer, one write(2)
+// ------------------------------------------------------------------
+#define EXH_TRACE_BUFFER_SIZE   4096
+
+typedef struct TraceBuffer{
+    size_t len;
+    char data[EXH_TRACE_BUFFER_SIZE];
+} TraceBuffer;
+
+// -----------------------------------------------------------------
+// exhtrace_string() :: append a string, truncated when the buffer is full
+// -----------------------------------------------------------------
+static void exhtrace_string(TraceBuffer *buffer, const char *str){
+    if(str == NULL){ str = "?"; }
+    while(*str && buffer->len < EXH_TRACE_BUFFER_SIZE){
+        buffer->data[buffer->len++] = *str++;
+    }
+}
+
+// -----------------------------------------------------------------
+// exhtrace_number() :: append a decimal or 0x prefixed hexadecimal number
+// -----------------------------------------------------------------
+static void exhtrace_number(TraceBuffer *buffer, long long value, int hex){
+    char digits[24];
+    int i = sizeof(digits);
+    unsigned long long num = hex || value >= 0 ? value : -value;
+
+    digits[--i] = '\0';
+    do{
+        digits[--i] = "0123456789abcdef"[num % (hex ? 16 : 10)];
+        num /= hex ? 16 : 10;
+    }while(num > 0);
+    if(hex){
+        digits[--i] = 'x';
+        digits[--i] = '0';
+    }else if(value < 0){
+        digits[--i] = '-';
+    }
+    exhtrace_string(buffer, digits + i);
+}
+
+// -----------------------------------------------------------------
+// exhtrace_flush() :: write the buffer, retrying interrupted writes
+// -----------------------------------------------------------------
+static int exhtrace_flush(TraceBuffer *buffer, int fd){
+    size_t done = 0;
+    int saved = errno;
+    while(done < buffer->len){
+        ssize_t n = write(fd, buffer->data + done, buffer->len - done);
+        if(n < 0 && errno == EINTR){ continue; }
+        if(n <= 0){ break; }
+        done += n;
+    }
+    errno = saved;
+
+    return done == buffer->len ? 0 : -1;
+}
+
+// -- 78
+int exhwrite_stacktrace(Context *context, int fd){
+    TraceBuffer buffer;
+    ExceptionType *except;
+
+    // exhget_context() locks, a signal handler must not take that path
+    if(context == NULL){
+        context = EXHANDLER_MULTI_THREADING ? threadContext : &defaultContext;
+    }
+    if(context == NULL || context->stack == NULL ||
+        (except = stack_peek(context->stack, 1)) == NULL){
+        return -1;
+    }
+    buffer.len = 0;
+    if(except->class != NULL){
+        exhtrace_string(&buffer, except->class->name);
+        exhtrace_string(&buffer, " occured");
+    }else{
+        exhtrace_string(&buffer, "'try' trace");
+    }
+#if EXHANDLER_MULTI_THREADING
+    exhtrace_string(&buffer, " in thread ");
+    exhtrace_number(&buffer, EXHANDLER_THREAD_ID_FUNC(), 0);
+#endif
+    exhtrace_string(&buffer, ":\n");
+#ifdef EXHANDLER_BACKTRACE
+    for(int i=0; i < except->nframes; i++){
+        char *symbol = exhbacktrace_cached(except->frames[i]);
+        exhtrace_string(&buffer, "      #");
+        exhtrace_number(&buffer, i, 0);
+        exhtrace_string(&buffer, i < 10 ? "  " : " ");
+        exhtrace_number(&buffer, (uintptr_t)except->frames[i], 1);
+        if(symbol != NULL){
+            exhtrace_string(&buffer, " ");
+            exhtrace_string(&buffer, symbol);
+        }
+        exhtrace_string(&buffer, "\n");
+    }
+#endif
+    for(int i=0; i < except->ncauses; i++){
+        exhtrace_string(&buffer, "      caused by ");
+        exhtrace_string(&buffer, except->causes[i].class->name);
+        exhtrace_string(&buffer, ": file \"");
+        exhtrace_string(&buffer, except->causes[i].filename);
+        exhtrace_string(&buffer, "\", line ");
+        exhtrace_number(&buffer, except->causes[i].lineno, 0);
+        exhtrace_string(&buffer, "\n");
+    }
+    for(int i=1; i <= stack_len(context->stack); i++){
+        except = stack_peek(context->stack, i);
+        exhtrace_string(&buffer, "      in 'try' at ");
+        exhtrace_string(&buffer, except->tryfile);
+        exhtrace_string(&buffer, ":");
+        exhtrace_number(&buffer, except->trylineno, 0);
+        exhtrace_string(&buffer, "\n");
+    }
+
+    return exhtrace_flush(&buffer, fd);
+}
+
+// ------------------------------------------------------------------
+// Thread registry :: seqlock published 'try' chain of every thread
+// ------------------------------------------------------------------
+#ifdef EXHANDLER_REGISTRY
+#define EXH_REGISTRY_RETRIES    64
+
+typedef struct ThreadEntry ThreadEntry;
+struct ThreadEntry{
+    ThreadEntry *next;
+    volatile int active;            // claimed by a thread inside a 'try'
+    volatile unsigned seq;          // odd while the owner updates
+    ThreadDump dump;
+};
+
+static ThreadEntry *volatile threadEntries;
+static EXHANDLER_THREAD_LOCAL ThreadEntry *threadEntry;
+
+#define EXH_REGISTRY_BEGIN(entry)                                   \
+    __atomic_store_n(&(entry)->seq, (entry)->seq + 1, __ATOMIC_RELAXED); \
+    __atomic_thread_fence(__ATOMIC_RELEASE)
+
+#define EXH_REGISTRY_END(entry)                                     \
+    __atomic_store_n(&(entry)->seq, (entry)->seq + 1, __ATOMIC_RELEASE)
+
+// -----------------------------------------------------------------
+// exhregistry_claim() :: reuse a free registry entry or add a new one
+// -----------------------------------------------------------------
+static ThreadEntry* exhregistry_claim(void){
+    ThreadEntry *entry = __atomic_load_n(&threadEntries, __ATOMIC_ACQUIRE);
+    for(; entry != NULL; entry = entry->next){
+        int idle = 0;
+        if(!entry->active && __atomic_compare_exchange_n(
+            &entry->active, &idle, 1, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED
+        )){
+            break;
+        }
+    }
+    if(entry == NULL){
+        if((entry = calloc(1, sizeof(ThreadEntry))) == NULL){ return NULL; }
+        entry->active = 1;
+        do{
+            entry->next = threadEntries;
+        }while(!__atomic_compare_exchange_n(
+            &threadEntries, &entry->next, entry, 0,
+            __ATOMIC_RELEASE, __ATOMIC_RELAXED
+        ));
+    }
+    EXH_REGISTRY_BEGIN(entry);
+    entry->dump.thread = EXHANDLER_THREAD_ID_FUNC();
+    entry->dump.depth = 0;
+    entry->dump.class = NULL;
+    EXH_REGISTRY_END(entry);
+
+    return entry;
+}
+
+// -----------------------------------------------------------------
+// exhregistry_push() :: publish a new innermost 'try'
+// -----------------------------------------------------------------
+static void exhregistry_push(char *filename, int lineno){
+    ThreadEntry *entry = threadEntry;
+    if(entry == NULL && (entry = threadEntry = exhregistry_claim()) == NULL){
+        return;
+    }
+    EXH_REGISTRY_BEGIN(entry);
+    if(entry->dump.depth < EXH_DUMP_DEPTH){
+        entry->dump.tries[entry->dump.depth].filename = filename;
+        entry->dump.tries[entry->dump.depth].lineno = lineno;
+    }
+    entry->dump.depth++;
+    EXH_REGISTRY_END(entry);
+}
+
+// -----------------------------------------------------------------
+// exhregistry_pop() :: drop the innermost 'try', release the entry at 0
+// -----------------------------------------------------------------
+static void exhregistry_pop(void){
+    ThreadEntry *entry = threadEntry;
+    if(entry == NULL){ return; }
+    EXH_REGISTRY_BEGIN(entry);
+    entry->dump.depth--;
+    // a propagating exception is published again by exhdeliver()
+    entry->dump.class = NULL;
+    EXH_REGISTRY_END(entry);
+    if(entry->dump.depth == 0){
+        threadEntry = NULL;
+        __atomic_store_n(&entry->active, 0, __ATOMIC_RELEASE);
+    }
+}
+
+// -----------------------------------------------------------------
+// exhregistry_except() :: publish the exception in flight
+// -----------------------------------------------------------------
+static void exhregistry_except(
+    ObjectRef class, State state, char *filename, int lineno
+){
+    ThreadEntry *entry = threadEntry;
+    if(entry == NULL){ return; }
+    EXH_REGISTRY_BEGIN(entry);
+    entry->dump.class = class;
+    entry->dump.state = state;
+    entry->dump.filename = filename;
+    entry->dump.lineno = lineno;
+    EXH_REGISTRY_END(entry);
+}
+
+// -----------------------------------------------------------------
+// exhregistry_read() :: consistent copy of an entry, 0 if it kept moving
+// -----------------------------------------------------------------
+static int exhregistry_read(ThreadEntry *entry, ThreadDump *dump){
+    for(int i=0; i < EXH_REGISTRY_RETRIES; i++){
+        unsigned seq = __atomic_load_n(&entry->seq, __ATOMIC_ACQUIRE);
+        if(seq & 1){ continue; }
+        memcpy(dump, (void*)&entry->dump, sizeof(ThreadDump));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if(__atomic_load_n(&entry->seq, __ATOMIC_RELAXED) == seq){
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+// -----------------------------------------------------------------
+// exhdump_sigquit() :: SIGQUIT handler
+// -----------------------------------------------------------------
+static void exhdump_sigquit(int num){
+    exhdump_print(STDERR_FILENO);
+}
+#endif /* EXHANDLER_REGISTRY */
+
+// -- 79
+int exhdump_snapshot(ThreadDump *dumps, int size){
+    int count = 0;
+#ifdef EXHANDLER_REGISTRY
+    ThreadEntry *entry = __atomic_load_n(&threadEntries, __ATOMIC_ACQUIRE);
+    for(; entry != NULL; entry = entry->next){
+        ThreadDump dump;
+        if(!__atomic_load_n(&entry->active, __ATOMIC_ACQUIRE) ||
+            !exhregistry_read(entry, &dump) || dump.depth <= 0){
+            continue;
+        }
+        if(count < size){ dumps[count] = dump; }
+        count++;
+    }
+#endif
+    return count;
+}
+
+// -- 80
+void exhdump_print(int fd){
+#ifdef EXHANDLER_REGISTRY
+    ThreadEntry *entry = __atomic_load_n(&threadEntries, __ATOMIC_ACQUIRE);
+    for(; entry != NULL; entry = entry->next){
+        TraceBuffer buffer;
+        ThreadDump dump;
+        int depth;
+        if(!__atomic_load_n(&entry->active, __ATOMIC_ACQUIRE) ||
+            !exhregistry_read(entry, &dump) || dump.depth <= 0){
+            continue;
+        }
+        buffer.len = 0;
+        exhtrace_string(&buffer, "thread ");
+        exhtrace_number(&buffer, dump.thread, 0);
+        exhtrace_string(&buffer, ", 'try' depth ");
+        exhtrace_number(&buffer, dump.depth, 0);
+        exhtrace_string(&buffer, ":\n");
+        if(dump.class != NULL){
+            exhtrace_string(&buffer, "      ");
+            exhtrace_string(&buffer, dump.class->name);
+            exhtrace_string(
+                &buffer, dump.state == CAUGHT_STATE ? " caught" : " pending"
+            );
+            exhtrace_string(&buffer, ", thrown at ");
+            exhtrace_string(&buffer, dump.filename);
+            exhtrace_string(&buffer, ":");
+            exhtrace_number(&buffer, dump.lineno, 0);
+            exhtrace_string(&buffer, "\n");
+        }
+        depth = dump.depth < EXH_DUMP_DEPTH ? dump.depth : EXH_DUMP_DEPTH;
+        for(int i=depth-1; i >= 0; i--){
+            exhtrace_string(&buffer, "      in 'try' at ");
+            exhtrace_string(&buffer, dump.tries[i].filename);
+            exhtrace_string(&buffer, ":");
+            exhtrace_number(&buffer, dump.tries[i].lineno, 0);
+            exhtrace_string(&buffer, "\n");
+        }
+        exhtrace_flush(&buffer, fd);
+    }
+#endif
+}
+
+// -- 81
+int exhdump_install_sigquit(void){
+#ifdef EXHANDLER_REGISTRY
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    sigemptyset(&action.sa_mask);
+    action.sa_handler = exhdump_sigquit;
+    action.sa_flags = SA_RESTART;
+    return sigaction(SIGQUIT, &action, NULL) == 0;
+#else
+    return 0;
+#endif
+}
+
+// -- 40
+Scope exhget_scope(Context *cptr){
+    Scope scope;
+    if(cptr == NULL){
+        cptr = exhget_context(NULL);
+    }
+    exhprint_debug(cptr, "exhget_scope");
+    if(cptr == NULL || cptr->except == NULL){ scope = OUTSITE_SCOPE; }
+    else{
+        scope = ((ExceptionType*)stack_peek(cptr->stack, 1))->scope;
+    }
+    return scope;
+}
+
+// -- 41
+Context* exhget_context(Context *cptr){
+#if EXHANDLER_MULTI_THREADING
+    // the calling thread's own context needs neither lock nor dictionary
+    if(cptr == NULL){ cptr = threadContext; }
+    if(cptr == NULL && contextDict != NULL){
+        EXHANDLER_THREAD_MUTEX_FUNC(1);
+        cptr = dict_get(contextDict, EXHANDLER_THREAD_ID_FUNC());
+        EXHANDLER_THREAD_MUTEX_FUNC(0);
+    }
+    return cptr;
+#else
+    return &defaultContext;
+#endif
+}
+
+// -----------------------------------------------------------------
+// exhnew_context() :: create exception handling context for thread
+// -----------------------------------------------------------------
+#if EXHANDLER_MULTI_THREADING
+static Context* exhnew_context(void){
+    Context *context;
+    context = calloc(1, sizeof(Context));
+    if(context == NULL && exhmem_release_reserve() > 0){
+        context = calloc(1, sizeof(Context));
+    }
+    if(context == NULL){
+        fprintf(stderr, "exhandler internal error: out of memory.\n");
+    }
+    EXHANDLER_THREAD_MUTEX_FUNC(1);
+    dict_put(contextDict, EXHANDLER_THREAD_ID_FUNC(), context);
+    EXHANDLER_THREAD_MUTEX_FUNC(0);
+    threadContext = context;
+#ifdef EXHANDLER_USE_PTHREAD
+    context->thread = (unsigned long)pthread_self();
+#endif
+    exhprint_debug(context, "exhnew_conext");
+
+    return context;
+}
+#else
+#define exhnew_context()    NULL
+#endif
+
+// -----------------------------------------------------------------
+// exhget_description()
+// -----------------------------------------------------------------
+static char* exhget_description(void){
+    static EXHANDLER_THREAD_LOCAL char description[1024];
+    Context *context = exhget_context(NULL);
+    exhprint_debug(context, "exhget_description");
+    snprintf(
+        description, sizeof(description), "%s: file \"%s\", line %d.",
+        context->except->class->name, context->except->filename,
+        context->except->lineno
+    );
+
+    return description;
+}
+
+// -----------------------------------------------------------------
+// exhget_class() :: get current exception class
+// -----------------------------------------------------------------
+static ObjectRef exhget_class(void){
+    Context *context = exhget_context(NULL);
+    exhprint_debug(context, "exhget_class");
+    return context->except->class;
+}
+
+// -----------------------------------------------------------------
+// exhget_data() :: get current exception associated data
+// -----------------------------------------------------------------
+static void* exhget_data(void){
+    Context *context = exhget_context(NULL);
+    exhprint_debug(context, "exhget_data");
+    return context->except->data;
+}
+
+// -----------------------------------------------------------------
+// exhprind_stacktrace() :: print the nested 'try' trace
+// -----------------------------------------------------------------
+static void exhprint_stacktrace(FILE *fileptr){
+    Context *context = exhget_context(NULL);
+    exhprint_debug(context, "exhprint_stacktrace");
+    if(fileptr == NULL){ fileptr = stderr; }
+
+#if EXHANDLER_MULTI_THREADING
+    fprintf(
+        fileptr, "%s occured in thread %d:\n",
+        context->except->class->name, EXHANDLER_THREAD_ID_FUNC()
+    );
+#else
+    fprintf(fileptr, "%s occured:\n", context->except->class->name);
+#endif
+#ifdef EXHANDLER_BACKTRACE
+    for(int i=0; i < context->except->nframes; i++){
+        void *pc = context->except->frames[i];
+        char *symbol = exhbacktrace_symbol(pc);
+        char buffer[512];
+        if(symbol == NULL){
+            exhbacktrace_resolve(pc, buffer, sizeof(buffer));
+            symbol = buffer;
+        }
+        fprintf(fileptr, "      #%-2d %p %s\n", i, pc, symbol);
+    }
+#endif
+    for(int i=0; i < context->except->ncauses; i++){
+        ExceptionCause *cause = &context->except->causes[i];
+        fprintf(
+            fileptr, "      caused by %s: file \"%s\", line %d\n",
+            cause->class->name, cause->filename, cause->lineno
+        );
+    }
+    for(int i=1; i <= stack_len(context->stack); i++){
+        ExceptionType *except = stack_peek(context->stack, i);
+        fprintf(
+            fileptr, "      in 'try' at %s:%d\n",
+            except->tryfile, except->trylineno
+        );
+    }
+}
+
+static void exhthrow_signal(int num);
+
+#ifdef EXHANDLER_FLIGHT_RECORDER
+// -----------------------------------------------------------------
+// exhthrow_siginfo() :: keep the fault address for the recorder, 'throw'
+// -----------------------------------------------------------------
+static void exhthrow_siginfo(int num, siginfo_t *info, void *ucontext){
+    faultAddress = info->si_addr;
+    faultSignal = num;
+    exhthrow_signal(num);
+}
+#endif
+
+// -----------------------------------------------------------------
+// exhsignal() :: install 'handler', the previous action is saved in
+// 'old' whole so that a foreign SA_SIGINFO handler comes back intact
+// -----------------------------------------------------------------
+static int exhsignal(int num, exh_sighandlerFn handler, struct sigaction *old){
+    struct sigaction action;
+
+    memset(&action, 0, sizeof(action));
+    sigemptyset(&action.sa_mask);
+    action.sa_handler = handler;
+    action.sa_flags = SA_RESTART;
+#ifdef EXHANDLER_FLIGHT_RECORDER
+    if(handler == exhthrow_signal){
+        action.sa_sigaction = exhthrow_siginfo;
+        action.sa_flags |= SA_SIGINFO;
+    }
+#endif
+
+    return sigaction(num, &action, old);
+}
+
+// -----------------------------------------------------------------
+// exhsignal_unblock() :: a try_nosig frame will not restore the mask
+// -----------------------------------------------------------------
+static void exhsignal_unblock(Context *context, int num){
+    sigset_t set;
+    if(context == NULL || context->except == NULL ||
+        context->except->savemask){
+        return;
+    }
+    // siglongjmp() leaves the handler with 'num' still blocked otherwise
+    sigemptyset(&set);
+    sigaddset(&set, num);
+#ifdef EXHANDLER_USE_PTHREAD
+    pthread_sigmask(SIG_UNBLOCK, &set, NULL);
+#else
+    sigprocmask(SIG_UNBLOCK, &set, NULL);
+#endif
+}
+
+#if defined(EXHANDLER_USE_PTHREAD) || defined(EXHANDLER_DEADLINE)
+// -----------------------------------------------------------------
+// exhasync_safe() :: may a signal handler throw into this thread now?
+// only from the body of a 'try', outside the library, none pending
+// -----------------------------------------------------------------
+static int exhasync_safe(Context *context){
+    ExceptionType *except;
+    if(context == NULL || context->busy != 0 || context->stack == NULL ||
+        stack_len(context->stack) == 0){
+        return 0;
+    }
+    except = context->except;
+
+    return except != NULL && except->scope == TRY_SCOPE &&
+        except->state == EMPTY_STATE;
+}
+#endif
+
+// -----------------------------------------------------------------
+// exhthrow_signal() :: 'throw' exception caused by signal
+// -----------------------------------------------------------------
+static void exhthrow_signal(int num){
+    ObjectRef objref;
+    exhprint_debug(cptr, "exhthrow_signal");
+#ifdef EXHANDLER_DEADLINE
+    if(num == EXH_TIMEOUT_SIGNAL){
+        // a late tick for a 'try' that already finished, or was relaxed
+        if(!exhdeadline_expired()){ return; }
+        // not a trap, it waits until the thread can take it
+        if(!exhasync_safe(threadContext)){
+            exhdeadline_retry();
+            return;
+        }
+        objref = TimeoutError;
+    }else
+#endif
+    switch(num){
+    case SIGABRT:
+        objref = AbnormalTerminationError;
+        break;
+    case SIGFPE:
+        objref = ArithmethicError;
+        break;
+    case SIGILL:
+        objref = IllegalInstructionError;
+        break;
+    case SIGSEGV:
+        objref = SegmentationError;
+        break;
+#ifdef SIGBUS
+    case SIGBUS:
+        objref = BusError;
+        break;
+#endif
+    default:
+        return;
+    }
+
+    exhsignal_unblock(threadContext, num);
+    objref->signum = num;
+    EXH_PROBE_SIGNAL(
+        objref->name, threadContext && threadContext->stack ?
+            stack_len(threadContext->stack) : 0, num
+    );
+    exhthrow(NULL, objref, NULL, "?", 0);
+}
+
+#ifdef EXHANDLER_USE_PTHREAD
+static volatile int cancelInstalled;
+
+// -----------------------------------------------------------------
+// exhcancel_signal() :: throw the exception left by exhcancel()
+// -----------------------------------------------------------------
+static void exhcancel_signal(int num){
+    Context *context = EXHANDLER_MULTI_THREADING ?
+        threadContext : &defaultContext;
+    if(!exhasync_safe(context)){
+        return;     // 'cancel' stays set for the next cancel point
+    }
+    EXH_PROBE_SIGNAL(
+        context->cancel ? context->cancel->name : NULL,
+        stack_len(context->stack), num
+    );
+    exhsignal_unblock(context, num);
+    exhcancel_throw(context, "?", 0);
+}
+#endif
+
+// -- 86
+int exhcancel(int thread, ObjectRef cls, int async){
+    Context *context = NULL;
+    int found = 0;
+#if EXHANDLER_MULTI_THREADING
+    EXHANDLER_THREAD_MUTEX_FUNC(1);
+    if(contextDict != NULL){
+        context = dict_get(contextDict, thread);
+    }
+#else
+    context = &defaultContext;
+#endif
+    if(context != NULL && context->stack != NULL){
+        __atomic_store_n(&context->cancel, cls, __ATOMIC_RELEASE);
+        found = 1;
+#ifdef EXHANDLER_USE_PTHREAD
+        if(async && context->thread != 0){
+            if(!__atomic_exchange_n(&cancelInstalled, 1, __ATOMIC_ACQ_REL)){
+                struct sigaction action;
+                memset(&action, 0, sizeof(action));
+                sigemptyset(&action.sa_mask);
+                action.sa_handler = exhcancel_signal;
+                action.sa_flags = SA_RESTART;
+                sigaction(EXH_CANCEL_SIGNAL, &action, NULL);
+            }
+            // still under exhmutex, the context cannot go away meanwhile
+            pthread_kill((pthread_t)context->thread, EXH_CANCEL_SIGNAL);
+        }
+#endif
+    }
+#if EXHANDLER_MULTI_THREADING
+    EXHANDLER_THREAD_MUTEX_FUNC(0);
+#endif
+
+    return found;
+}
+
+// -- 87
+void exhcancel_throw(Context *context, char *filename, int lineno){
+    ObjectRef cls;
+    if(context == NULL){ context = exhget_context(NULL); }
+    if(context == NULL || context->stack == NULL ||
+        stack_len(context->stack) == 0){
+        return;
+    }
+    cls = __atomic_exchange_n(&context->cancel, NULL, __ATOMIC_ACQUIRE);
+    if(cls != NULL){
+        exhthrow(context, cls, NULL, filename, lineno);
+    }
+}
+
+// ------------------------------------------------------------------
+// Deadlines :: a per-thread POSIX timer throwing TimeoutError
+// ------------------------------------------------------------------
+#ifdef EXHANDLER_DEADLINE
+#ifndef sigev_notify_thread_id
+#define sigev_notify_thread_id  _sigev_un._tid
+#endif
+#define EXH_DEADLINE_RETRY_NS   1000000     /* late throw, thread was busy */
+
+static EXHANDLER_THREAD_LOCAL unsigned long long deadlineActive;
+// -1 when timer_create() failed, deadlines are then not enforced
+static EXHANDLER_THREAD_LOCAL int deadlineReady;
+static EXHANDLER_THREAD_LOCAL timer_t deadlineTimer;
+#ifdef EXHANDLER_USE_PTHREAD
+static pthread_once_t deadlineOnce = PTHREAD_ONCE_INIT;
+static pthread_key_t deadlineKey;
+
+// -----------------------------------------------------------------
+// exhdeadline_delete() :: thread exit, give the timer back
+// -----------------------------------------------------------------
+static void exhdeadline_delete(void *timer){
+    timer_delete(*(timer_t*)timer);
+}
+#else
+static int deadlineOnce;
+#endif
+
+// -----------------------------------------------------------------
+// exhdeadline_init() :: once per process, install the timeout handler
+// -----------------------------------------------------------------
+static void exhdeadline_init(void){
+    exhsignal(EXH_TIMEOUT_SIGNAL, exhthrow_signal, NULL);
+#ifdef EXHANDLER_USE_PTHREAD
+    pthread_key_create(&deadlineKey, exhdeadline_delete);
+#endif
+}
+
+// -----------------------------------------------------------------
+// exhdeadline_timer() :: create the timer of the calling thread
+// -----------------------------------------------------------------
+static int exhdeadline_timer(void){
+    struct sigevent event;
+
+    if(deadlineReady){ return deadlineReady > 0; }
+#ifdef EXHANDLER_USE_PTHREAD
+    pthread_once(&deadlineOnce, exhdeadline_init);
+#else
+    if(!deadlineOnce){
+        deadlineOnce = 1;
+        exhdeadline_init();
+    }
+#endif
+    memset(&event, 0, sizeof(event));
+    event.sigev_notify = SIGEV_THREAD_ID;
+    event.sigev_signo = EXH_TIMEOUT_SIGNAL;
+    event.sigev_notify_thread_id = syscall(SYS_gettid);
+    if(timer_create(CLOCK_MONOTONIC, &event, &deadlineTimer) < 0){
+        deadlineReady = -1;
+        return 0;
+    }
+    deadlineReady = 1;
+#ifdef EXHANDLER_USE_PTHREAD
+    pthread_setspecific(deadlineKey, &deadlineTimer);
+#endif
+
+    return 1;
+}
+
+// -----------------------------------------------------------------
+// exhdeadline_now() :: monotonic time stamp in nanoseconds
+// -----------------------------------------------------------------
+static unsigned long long exhdeadline_now(void){
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+// -----------------------------------------------------------------
+// exhdeadline_set() :: make 'deadline' the one in force, 0 disarms
+// -----------------------------------------------------------------
+static void exhdeadline_set(unsigned long long deadline){
+    struct itimerspec spec;
+
+    // published before arming, so an early tick finds it not yet expired
+    deadlineActive = deadline;
+    if(deadlineReady <= 0){ return; }
+    memset(&spec, 0, sizeof(spec));
+    spec.it_value.tv_sec = deadline / 1000000000ULL;
+    spec.it_value.tv_nsec = deadline % 1000000000ULL;
+    timer_settime(deadlineTimer, TIMER_ABSTIME, &spec, NULL);
+}
+
+// -----------------------------------------------------------------
+// exhdeadline_retry() :: tick again shortly, the expired deadline could
+// not be thrown yet
+// -----------------------------------------------------------------
+static void exhdeadline_retry(void){
+    struct itimerspec spec;
+
+    memset(&spec, 0, sizeof(spec));
+    spec.it_value.tv_nsec = EXH_DEADLINE_RETRY_NS;
+    timer_settime(deadlineTimer, 0, &spec, NULL);
+}
+
+// -----------------------------------------------------------------
+// exhdeadline_expired() :: has the deadline in force passed
+// -----------------------------------------------------------------
+static int exhdeadline_expired(void){
+    return deadlineActive != 0 && exhdeadline_now() >= deadlineActive;
+}
+#endif /* EXHANDLER_DEADLINE */
+
+// -- 88
+void exhdeadline(Context *context, long long ns){
+#ifdef EXHANDLER_DEADLINE
+    unsigned long long deadline;
+
+    if(context == NULL){ context = exhget_context(NULL); }
+    if(context == NULL || context->except == NULL || !exhdeadline_timer()){
+        return;
+    }
+    deadline = exhdeadline_now() + (ns > 0 ? ns : 1);
+    // a nested deadline never outlives the enclosing one
+    if(deadlineActive != 0 && deadlineActive <= deadline){ return; }
+    exhdeadline_set(deadline);
+#endif
+}
+
+// ------------------------------------------------------------------
+// Class registry :: classes by name, names interned into dense ids
+// ------------------------------------------------------------------
+static ObjectRef *classIds;         // id -> class, id 0 unused
+static int *classNames;             // open addressed by name, -> id
+static int classCount;              // ids handed out
+static unsigned classSize;          // slots of classNames, power of 2
+
+// -----------------------------------------------------------------
+// exhclass_slot() :: slot of 'name' in classNames, an empty one if absent
+// -----------------------------------------------------------------
+static int* exhclass_slot(const char *name){
+    unsigned hash = 2166136261u;
+    const char *ch;
+
+    for(ch=name; *ch; ch++){ hash = (hash ^ (unsigned char)*ch) * 16777619u; }
+    for(;; hash++){
+        int *slot = &classNames[hash & (classSize - 1)];
+        if(*slot == 0 || strcmp(classIds[*slot]->name, name) == 0){
+            return slot;
+        }
+    }
+}
+
+// -----------------------------------------------------------------
+// exhclass_grow() :: make room for one more class, at most half full
+// -----------------------------------------------------------------
+static int exhclass_grow(void){
+    unsigned size = classSize ? classSize * 2 : 64;
+    ObjectRef *ids;
+    int *names;
+
+    if((unsigned)(classCount + 1) * 2 <= classSize){ return 1; }
+    if((ids = realloc(classIds, size * sizeof(ObjectRef))) == NULL){
+        return 0;
+    }
+    classIds = ids;
+    if((names = calloc(size, sizeof(int))) == NULL){ return 0; }
+    free(classNames);
+    classNames = names;
+    classSize = size;
+    for(int id=1; id <= classCount; id++){
+        *exhclass_slot(classIds[id]->name) = id;
+    }
+
+    return 1;
+}
+
+// -----------------------------------------------------------------
+// exhclass_intern() :: id of a class and its ancestors, mutex held
+// -----------------------------------------------------------------
+static int exhclass_intern(ObjectRef class){
+    ObjectRef known;
+    int *slot;
+
+    if(class->id != 0){ return class->id; }
+    if(class->parent != NULL && !exhclass_intern(class->parent)){ return 0; }
+    if(!exhclass_grow()){ return 0; }
+    slot = exhclass_slot(class->name);
+    if(*slot == 0){
+        classIds[*slot = ++classCount] = class;
+        return class->id = *slot;
+    }
+    // the same name under another parent is another class
+    known = classIds[*slot];
+    if(known->parent == NULL ? class->parent != NULL :
+        class->parent == NULL || known->parent->id != class->parent->id){
+        return 0;
+    }
+
+    return class->id = *slot;
+}
+
+// -----------------------------------------------------------------
+// exhclass_init() :: register the classes of exhandler.h, mutex held
+// -----------------------------------------------------------------
+static void exhclass_init(void){
+    static ObjectRef builtins[] = {
+        Throwable, Exception, OutOfMemoryError, FailedAssertionError,
+        RuntimeError, AbnormalTerminationError, ArithmethicError,
+        IllegalInstructionError, SegmentationError, BusError,
+        AggregateError, TimeoutError,
+    };
+    if(classCount != 0){ return; }
+    for(size_t i=0; i < sizeof(builtins) / sizeof(builtins[0]); i++){
+        exhclass_intern(builtins[i]);
+    }
+}
+
+// -- 90
+int exhclass_register(ObjectRef class){
+    int id;
+
+    exh_validate(class != NULL, 0);
+    EXHANDLER_THREAD_MUTEX_FUNC(1);
+    exhclass_init();
+    id = exhclass_intern(class);
+    EXHANDLER_THREAD_MUTEX_FUNC(0);
+
+    return id;
+}
+
+// -- 91
+ObjectRef exhclass_define(const char *name, ObjectRef parent){
+    ObjectRef class = NULL;
+    int *slot;
+
+    exh_validate(name != NULL && *name, NULL);
+    if(parent == NULL){ parent = Exception; }
+    EXHANDLER_THREAD_MUTEX_FUNC(1);
+    exhclass_init();
+    if(exhclass_intern(parent) && exhclass_grow()){
+        slot = exhclass_slot(name);
+        if(*slot != 0){
+            class = classIds[*slot];
+            if(class->parent == NULL || class->parent->id != parent->id){
+                class = NULL;
+            }
+        }else if((class = calloc(1, sizeof(*class))) != NULL){
+            if((class->name = malloc(strlen(name) + 1)) == NULL){
+                free(class);
+                class = NULL;
+            }else{
+                strcpy(class->name, name);
+                class->norethrow = 1;
+                class->parent = parent;
+                classIds[*slot = ++classCount] = class;
+                class->id = *slot;
+            }
+        }
+    }
+    EXHANDLER_THREAD_MUTEX_FUNC(0);
+
+    return class;
+}
+
+// -- 92
+ObjectRef exhclass_find(const char *name){
+    ObjectRef class = NULL;
+    int *slot;
+
+    exh_validate(name != NULL, NULL);
+    EXHANDLER_THREAD_MUTEX_FUNC(1);
+    exhclass_init();
+    if(*(slot = exhclass_slot(name)) != 0){ class = classIds[*slot]; }
+    EXHANDLER_THREAD_MUTEX_FUNC(0);
+
+    return class;
+}
+
+// -- 93
+ObjectRef exhclass_get(int id){
+    ObjectRef class = NULL;
+
+    EXHANDLER_THREAD_MUTEX_FUNC(1);
+    exhclass_init();
+    if(id > 0 && id <= classCount){ class = classIds[id]; }
+    EXHANDLER_THREAD_MUTEX_FUNC(0);
+
+    return class;
+}
+
+// -----------------------------------------------------------------
+// exhinstall_handlers() :: Install signal/trap handler if needed
+// -----------------------------------------------------------------
+static int exhinstall_handlers(Context *context){
+    int stored = 0;
+    if(!context->trapping){
+        EXHANDLER_THREAD_MUTEX_FUNC(1);
+        if(EXHANDLER_MULTI_THREADING && EXHANDLER_SHARE && numThreadsTry++ ==0){
+            exhsignal(SIGABRT, exhthrow_signal, &shared_abort_action);
+            exhsignal(SIGFPE, exhthrow_signal, &shared_fpe_action);
+            exhsignal(SIGILL, exhthrow_signal, &shared_ill_action);
+            exhsignal(SIGSEGV, exhthrow_signal, &shared_segv_action);
+#ifdef SIGBUS
+            exhsignal(SIGBUS, exhthrow_signal, &shared_bus_action);
+#endif
+            stored = 1;
+        }else if(!EXHANDLER_MULTI_THREADING || !EXHANDLER_SHARE){
+            exhsignal(SIGABRT, exhthrow_signal, &context->abortaction);
+            exhsignal(SIGFPE, exhthrow_signal, &context->fpeaction);
+            exhsignal(SIGILL, exhthrow_signal, &context->illaction);
+            exhsignal(SIGSEGV, exhthrow_signal, &context->segvaction);
+#ifdef SIGBUS
+            exhsignal(SIGBUS, exhthrow_signal, &context->busaction);
+#endif
+            stored = 1;
+        }
+        // counted in numThreadsTry even when another thread installed them
+        context->trapping = 1;
+        EXHANDLER_THREAD_MUTEX_FUNC(0);
+    }
+
+    return stored;
+}
+
+// -----------------------------------------------------------------
+// exhrestore_handlers() :: restore signal/trap handlers if needed
+// -----------------------------------------------------------------
+static int exhresore_handlers(Context *context){
+    int restored = 0;
+    // a thread that only ran try_nosig blocks never installed them
+    if(!context->trapping){ return 0; }
+    context->trapping = 0;
+    EXHANDLER_THREAD_MUTEX_FUNC(1);
+    if(EXHANDLER_MULTI_THREADING && EXHANDLER_SHARE && --numThreadsTry == 0){
+        sigaction(SIGABRT, &shared_abort_action, NULL);
+        sigaction(SIGFPE, &shared_fpe_action, NULL);
+        sigaction(SIGILL, &shared_ill_action, NULL);
+        sigaction(SIGSEGV, &shared_segv_action, NULL);
+#ifdef SIGBUS
+        sigaction(SIGBUS, &shared_bus_action, NULL);
+#endif
+        restored = 1;
+    }else if(!EXHANDLER_MULTI_THREADING || !EXHANDLER_SHARE){
+        sigaction(SIGABRT, &context->abortaction, NULL);
+        sigaction(SIGFPE, &context->fpeaction, NULL);
+        sigaction(SIGILL, &context->illaction, NULL);
+        sigaction(SIGSEGV, &context->segvaction, NULL);
+#ifdef SIGBUS
+        sigaction(SIGBUS, &context->busaction, NULL);
+#endif
+        restored = 1;
+    }
+    EXHANDLER_THREAD_MUTEX_FUNC(0);
+
+    return restored;
+}
+
+// -----------------------------------------------------------------
+// exhframe_new() :: a zeroed frame starting on a cache line, the
+// backtrace storage is allocated beside it
+// -----------------------------------------------------------------
+static ExceptionType* exhframe_new(void){
+    ExceptionType *except = aligned_alloc(
+        EXH_CACHE_LINE, sizeof(ExceptionType)
+    );
+    if(except == NULL){ return NULL; }
+    memset(except, 0, sizeof(ExceptionType));
+#ifdef EXHANDLER_BACKTRACE
+    // without it the frame records no backtrace, see exhdispatch()
+    except->frames = malloc(EXH_BACKTRACE_DEPTH * sizeof(void*));
+#endif
+
+    return except;
+}
+
+// -----------------------------------------------------------------
+// exhdelete_spares() :: free the frames kept for reuse by exhtry()
+// -----------------------------------------------------------------
+static void exhdelete_spares(Context *context){
+    ExceptionType *except;
+    while((except = context->spare) != NULL){
+        context->spare = except->next;
+        free(except->frames);
+        free(except->causes);
+        free(except);
+    }
+}
+
+// -- 42
+void exhthread_cleanup(int tid){
+#if EXHANDLER_MULTI_THREADING
+    exh_validate(tid != EXHANDLER_THREAD_ID_FUNC(), EXH_NOTHING);
+    if(tid == -1){
         tid = EXHANDLER_THREAD_ID_FUNC();
     }
     EXHANDLER_THREAD_MUTEX_FUNC(1);
@@ -391,51 +2997,170 @@ void exhthread_cleanup(int tid){
             if(context->except->checklist != NULL){
                 list_delete_with_data(context->except->checklist);
             }
+            exhdelete_spares(context);
             free(dict_remove(contextDict, tid));
+            if(context == threadContext){ threadContext = NULL; }
         }
     }
     EXHANDLER_THREAD_MUTEX_FUNC(0);
 #endif
 }
 
-// -- 43
-void exhtry(Context *context, char *filename, int lineno){
+// -----------------------------------------------------------------
+// exhpush() :: push the frame of a new 'try', 'savemask' 0 for try_nosig
+// -----------------------------------------------------------------
+static void exhpush(
+    Context *context, char *filename, int lineno, int savemask
+){
 #if EXHANDLER_MULTI_THREADING
-    EXHANDLER_THREAD_MUTEX_FUNC(1);
-    if(contextDict == NULL){
-        contextDict = dict_new();
+    // published complete: the check outside the lock sees it or NULL
+    if(__atomic_load_n(&contextDict, __ATOMIC_ACQUIRE) == NULL){
+        EXHANDLER_THREAD_MUTEX_FUNC(1);
+        if(contextDict == NULL){
+            __atomic_store_n(&contextDict, dict_new(), __ATOMIC_RELEASE);
+        }
+        EXHANDLER_THREAD_MUTEX_FUNC(0);
     }
-    EXHANDLER_THREAD_MUTEX_FUNC(0);
 #endif
-    int first;
-    if(first = (context == NULL)){ context = exhget_context(NULL);}
+    int first = context == NULL;
+    if(first){ context = exhget_context(NULL); }
     if(context == NULL){ context = exhnew_context(); }
+    EXH_BUSY_BEGIN(context);
 
-    exhinstall_handlers(context);
-    stack_push(
-        context->stack, context->except=calloc(1, sizeof(ExceptionType))
-    );
+    if(savemask){ exhinstall_handlers(context); }
+    if(context->stack == NULL){ context->stack = stack_new(); }
+    if(!__atomic_load_n(&processReserveSet, __ATOMIC_ACQUIRE)){
+        exhmem_default_reserve();
+    }
+    ExceptionType *except = context->spare;
+    if(except != NULL){
+        context->spare = except->next;
+        exhframe_reset(except);
+    }else{
+        except = exhframe_new();
+        if(except == NULL && exhmem_release_reserve() > 0){
+            except = exhframe_new();
+        }
+        if(except == NULL){
+            // the enclosing 'try' handles it, without one there is no way on
+            if(stack_len(context->stack) > 0){
+                exhthrow(context, OutOfMemoryError, NULL, filename, lineno);
+            }
+            fprintf(
+                stderr, "OutOfMemoryError: no memory for the 'try' at "
+                "file \"%s\", line %d.\n", filename, lineno
+            );
+            exhresore_handlers(context);
+            abort();
+        }
+    }
+    stack_push(context->stack, context->except=except);
     context->except->first = first;
+    context->except->savemask = savemask;
     context->except->tryfile = filename;
     context->except->trylineno = lineno;
+#ifdef EXHANDLER_DEADLINE
+    context->except->deadline = deadlineActive;
+#endif
+    exhregistry_push(filename, lineno);
+    EXH_PROBE(try_begin, NULL, filename, lineno, stack_len(context->stack));
+    EXH_BUSY_END(context);
 
     exhprint_debug(context, "exhtry");
 }
 
-// -- 44
-void exhthrow(
-    Context *context, void *exceptObj, void *data, char *filename, int lineno
-){
-    exhprint_debug(context, "exhthrow");
-    if(context == NULL){
-        context = exhget_context(NULL);
+// -- 43
+void exhtry(Context *context, char *filename, int lineno){
+    exhpush(context, filename, lineno, 1);
+}
+
+// -- 89
+void exhtry_nosig(Context *context, char *filename, int lineno){
+    exhpush(context, filename, lineno, 0);
+}
+
+// -----------------------------------------------------------------
+// exhcause_chain() :: 'cause' then its own causes, at most
+// EXH_CAUSE_DEPTH of them
+// -----------------------------------------------------------------
+static int exhcause_chain(ExceptionType *cause, ExceptionCause *chain){
+    int n = 0;
+    if(cause == NULL || cause->class == NULL){ return 0; }
+    chain[n].class = cause->class;
+    chain[n].data = cause->data;
+    chain[n].filename = cause->filename;
+    chain[n].lineno = cause->lineno;
+    for(n++; n < EXH_CAUSE_DEPTH && n <= cause->ncauses; n++){
+        chain[n] = cause->causes[n - 1];
+    }
+
+    return n;
+}
+
+// -----------------------------------------------------------------
+// exhdeliver() :: jump to the innermost 'try', its exception pending
+// -----------------------------------------------------------------
+static void exhdeliver(Context *context){
+    context->except->state = PENDING_STATE;
+    exhregistry_except(
+        context->except->class, PENDING_STATE, context->except->filename,
+        context->except->lineno
+    );
+    __atomic_signal_fence(__ATOMIC_SEQ_CST);
+    context->busy = 0;
+    switch(context->except->scope){
+    case TRY_SCOPE:
+        exhprint_debug(context, "longjmp(throwbuf)");
+        EXH_LONGJMP(context->except->throwbuf, 1);
+    case CATCH_SCOPE:
+        exhprint_debug(context, "longjmp(finalbuf)");
+        EXH_LONGJMP(context->except->finalbuf, 1);
+    case FINALLY_SCOPE:
+        exhprint_debug(context, "longjmp(finalbuf)");
+        EXH_LONGJMP(context->except->finalbuf, 1);
+    default:
+        // no buffer is set before the body of the 'try' begins
+        break;
     }
+}
 
+// -----------------------------------------------------------------
+// exhdispatch() :: jump to the innermost 'try' with a pending exception
+// -----------------------------------------------------------------
+static void exhdispatch(
+    Context *context, void *exceptObj, void *data, char *filename, int lineno,
+    unsigned long long throwtime, void **frames, int nframes,
+    ExceptionCause *causes, int ncauses
+){
     if(context==NULL || context->stack==NULL || stack_len(context->stack)==0){
-        fprintf(
-            stderr, "%s lost: file \"%s\", line %d.\n",
-            ((ObjectRef)exceptObj)->name, filename, lineno
+        exhstats_lost((ObjectRef)exceptObj);
+        exhflight_record(
+            EXH_EVENT_LOST, (ObjectRef)exceptObj, filename, lineno, context
         );
+        if(!exhevent_record(
+            EXH_EVENT_LOST, (ObjectRef)exceptObj, filename, lineno, NULL, 0
+        )){
+            // may run in exhthrow_signal(), no stdio here
+            TraceBuffer buffer;
+            buffer.len = 0;
+            exhtrace_string(&buffer, ((ObjectRef)exceptObj)->name);
+            exhtrace_string(&buffer, " lost: file \"");
+            exhtrace_string(&buffer, filename);
+            exhtrace_string(&buffer, "\", line ");
+            exhtrace_number(&buffer, lineno, 0);
+            exhtrace_string(&buffer, ".\n");
+            for(int i=0; i < ncauses; i++){
+                exhtrace_string(&buffer, "      caused by ");
+                exhtrace_string(&buffer, causes[i].class->name);
+                exhtrace_string(&buffer, ": file \"");
+                exhtrace_string(&buffer, causes[i].filename);
+                exhtrace_string(&buffer, "\", line ");
+                exhtrace_number(&buffer, causes[i].lineno, 0);
+                exhtrace_string(&buffer, "\n");
+            }
+            exhtrace_flush(&buffer, STDERR_FILENO);
+        }
+        EXH_BUSY_END(context);
         return;
     }
     if(((ObjectRef)exceptObj)->norethrow){
@@ -443,31 +3168,271 @@ void exhthrow(
         context->except->data = data;
         context->except->filename = filename;
         context->except->lineno = lineno;
+        context->except->throwtime = throwtime;
+        context->except->rethrown = 0;
+        context->except->nframes = context->except->frames ? nframes : 0;
+        if(context->except->nframes > 0){
+            memcpy(context->except->frames, frames, nframes * sizeof(void*));
+        }
+        // allocated by the first chained exception of the frame, then
+        // kept with it; without it the chain is dropped
+        if(ncauses > 0 && context->except->causes == NULL){
+            context->except->causes = malloc(
+                EXH_CAUSE_DEPTH * sizeof(ExceptionCause)
+            );
+        }
+        context->except->ncauses = context->except->causes ? ncauses : 0;
+        if(context->except->ncauses > 0){
+            memcpy(
+                context->except->causes, causes,
+                ncauses * sizeof(ExceptionCause)
+            );
+        }
         context->except->get_description = exhget_description;
         context->except->get_data = exhget_data;
         context->except->print_stacktrace = exhprint_stacktrace;
     }
-    context->except->state = PENDING_STATE;
-    switch(context->except->scope){
-    case TRY_SCOPE:
-        exhprint_debug(context, "longjmp(throwbuf)");
-        EXH_LONGJMP(context->except->throwbuf, 1);
-    case CATCH_SCOPE:
-        exhprint_debug(context, "longjmp(finalbuf)");
-        EXH_LONGJMP(context->except->finalbuf, 1);
-    case FINALLY_SCOPE:
-        exhprint_debug(context, "longjmp(finalbuf)");
-        EXH_LONGJMP(context->except->finalbuf, 1);
+    exhdeliver(context);
+}
+
+// -----------------------------------------------------------------
+// exhpropagate() :: hand the pending exception of a popped frame to
+// the enclosing 'try', the side storage is swapped, not copied
+// -----------------------------------------------------------------
+static void exhpropagate(Context *context, ExceptionType *self){
+    ExceptionType *except = context->except;
+
+    if(self->class->norethrow){
+        void **frames = except->frames;
+        ExceptionCause *causes = except->causes;
+        except->class = self->class;
+        except->data = self->data;
+        except->filename = self->filename;
+        except->lineno = self->lineno;
+        except->throwtime = self->throwtime;
+        except->rethrown = self->rethrown;
+        except->nframes = self->nframes;
+        except->frames = self->frames;
+        self->frames = frames;
+        except->ncauses = self->ncauses;
+        except->causes = self->causes;
+        self->causes = causes;
+        except->get_description = exhget_description;
+        except->get_data = exhget_data;
+        except->print_stacktrace = exhprint_stacktrace;
+    }
+    exhdeliver(context);
+}
+
+// -----------------------------------------------------------------
+// exhraise() :: account a new exception and dispatch it
+// -----------------------------------------------------------------
+static void exhraise(
+    Context *context, void *exceptObj, void *data, char *filename, int lineno,
+    void **frames, int nframes, ExceptionCause *causes, int ncauses
+){
+    exhstats_throw(
+        (ObjectRef)exceptObj, filename, lineno,
+        context && context->stack ? stack_len(context->stack) : 0
+    );
+    exhstats_causes(causes, ncauses);
+    exhevent_record(
+        EXH_EVENT_THROW, (ObjectRef)exceptObj, filename, lineno, NULL,
+        context && context->stack ? stack_len(context->stack) : 0
+    );
+    exhflight_record(
+        EXH_EVENT_THROW, (ObjectRef)exceptObj, filename, lineno, context
+    );
+    EXH_PROBE(
+        throw, ((ObjectRef)exceptObj)->name, filename, lineno,
+        context && context->stack ? stack_len(context->stack) : 0
+    );
+    exhdispatch(
+        context, exceptObj, data, filename, lineno, exhlatency_stamp(),
+        frames, nframes, causes, ncauses
+    );
+}
+
+// -- 44
+void exhthrow(
+    Context *context, void *exceptObj, void *data, char *filename, int lineno
+){
+    void *frames[EXH_BACKTRACE_DEPTH];
+    int nframes = 0;
+
+    exhprint_debug(context, "exhthrow");
+    if(context == NULL){
+        context = exhget_context(NULL);
+    }
+    EXH_BUSY_BEGIN(context);
+    if(context && context->stack && stack_len(context->stack)){
+        nframes = exhbacktrace_capture(frames);
+    }
+    exhraise(
+        context, exceptObj, data, filename, lineno, frames, nframes, NULL, 0
+    );
+}
+
+// -- 97
+void exhthrow_cause(
+    Context *context, void *exceptObj, void *data, ExceptionType *cause,
+    char *filename, int lineno
+){
+    ExceptionCause causes[EXH_CAUSE_DEPTH];
+    void *frames[EXH_BACKTRACE_DEPTH];
+    int nframes = 0, ncauses;
+
+    exhprint_debug(context, "exhthrow_cause");
+    if(context == NULL){
+        context = exhget_context(NULL);
     }
+    EXH_BUSY_BEGIN(context);
+    // taken first, the new exception may replace 'cause' in its frame
+    ncauses = exhcause_chain(cause, causes);
+    if(context && context->stack && stack_len(context->stack)){
+        nframes = exhbacktrace_capture(frames);
+    }
+    exhraise(
+        context, exceptObj, data, filename, lineno, frames, nframes,
+        causes, ncauses
+    );
+}
+
+// -- 98
+void exhrethrow_caught(Context *context, char *filename, int lineno){
+    exhprint_debug(context, "exhrethrow_caught");
+    if(context == NULL){
+        context = exhget_context(NULL);
+    }
+    if(context == NULL || context->stack == NULL ||
+        stack_len(context->stack) == 0 ||
+        context->except->state != CAUGHT_STATE){
+        fprintf(
+            stderr, "exh_rethrow() lost: no caught exception, file \"%s\", "
+            "line %d.\n", filename, lineno
+        );
+        return;
+    }
+    // same frame, same record: only the state goes back to pending
+    context->except->rethrown = 1;
+    exhdeliver(context);
+}
+
+// -- 82
+ExceptionRecord* exhcapture(Context *context){
+    ExceptionRecord *record;
+    ExceptionType *except;
+    int depth;
+
+    if(context == NULL){ context = exhget_context(NULL); }
+    if(context == NULL || context->stack == NULL ||
+        (except = stack_peek(context->stack, 1)) == NULL ||
+        except->state == EMPTY_STATE || except->class == NULL){
+        return NULL;
+    }
+    if((record = calloc(1, sizeof(ExceptionRecord))) == NULL){ return NULL; }
+    record->refcount = 1;
+    record->class = except->class;
+    record->data = except->data;
+    record->filename = except->filename;
+    record->lineno = except->lineno;
+    record->thread = EXHANDLER_THREAD_ID_FUNC();
+    record->depth = depth = stack_len(context->stack);
+    for(int i=0; i < depth && i < EXH_DUMP_DEPTH; i++){
+        ExceptionType *frame = stack_peek(context->stack, depth - i);
+        record->tries[i].filename = frame->tryfile;
+        record->tries[i].lineno = frame->trylineno;
+    }
+    record->nframes = except->nframes;
+    if(record->nframes > 0){
+        memcpy(record->frames, except->frames, record->nframes*sizeof(void*));
+    }
+    record->ncauses = except->ncauses;
+    if(record->ncauses > 0){
+        memcpy(
+            record->causes, except->causes,
+            record->ncauses * sizeof(ExceptionCause)
+        );
+    }
+
+    return record;
+}
+
+// -- 83
+ExceptionRecord* exhrecord_retain(ExceptionRecord *record){
+    if(record != NULL){
+        __atomic_add_fetch(&record->refcount, 1, __ATOMIC_RELAXED);
+    }
+    return record;
+}
+
+// -- 84
+void exhrecord_release(ExceptionRecord *record){
+    if(record != NULL &&
+        __atomic_sub_fetch(&record->refcount, 1, __ATOMIC_ACQ_REL) == 0){
+        free(record);
+    }
+}
+
+// -- 85
+void exhrethrow(Context *context, ExceptionRecord *record){
+    exhprint_debug(context, "exhrethrow");
+    if(record == NULL){ return; }
+    if(context == NULL){
+        context = exhget_context(NULL);
+    }
+    EXH_BUSY_BEGIN(context);
+    exhraise(
+        context, record->class, record->data, record->filename,
+        record->lineno, record->frames, record->nframes, record->causes,
+        record->ncauses
+    );
 }
 
 // --
 static int exhis_derived(ObjectRef objref, ObjectRef base){
-    while(objref->parent != NULL && objref != base){
+    // registered classes are the same class when their names are
+    int id = base->id;
+    while(objref->parent != NULL && objref != base &&
+        (id == 0 || objref->id != id)){
         objref = objref->parent;
     }
 
-    return objref == base;
+    return objref == base || (id != 0 && objref->id == id);
+}
+
+// -----------------------------------------------------------------
+// exhcatch_commit() :: mark the pending exception caught
+// -----------------------------------------------------------------
+static void exhcatch_commit(Context *context){
+    context->except->state = CAUGHT_STATE;
+    exhregistry_except(
+        context->except->class, CAUGHT_STATE, context->except->filename,
+        context->except->lineno
+    );
+    exhlatency_record(
+        context->except->class, context->except->throwtime, 0
+    );
+    // counted by the catch it was rethrown from
+    if(!context->except->rethrown){
+        exhstats_catch(
+            context->except->class, context->except->tryfile,
+            context->except->trylineno
+        );
+    }
+    exhevent_record(
+        EXH_EVENT_CATCH, context->except->class,
+        context->except->tryfile, context->except->trylineno, NULL,
+        stack_len(context->stack)
+    );
+    exhflight_record(
+        EXH_EVENT_CATCH, context->except->class,
+        context->except->tryfile, context->except->trylineno, context
+    );
+    EXH_PROBE(
+        catch, context->except->class->name, context->except->tryfile,
+        context->except->trylineno, stack_len(context->stack)
+    );
 }
 
 // -- 45
@@ -479,73 +3444,172 @@ int exhcatch(Context *context, ObjectRef object){
     if(context->except->state == PENDING_STATE &&
         exhis_derived(context->except->class, object)
     ){
-        context->except->state = CAUGHT_STATE;
+        exhcatch_commit(context);
+    }
+
+    return context->except->state == CAUGHT_STATE;
+}
+
+// -- 94
+int exhcatch_any(Context *context, ObjectRef const *set){
+    exhprint_debug(context, "exhcatch_any");
+    if(context == NULL){
+        context = exhget_context(NULL);
+    }
+    if(context->except->state == PENDING_STATE){
+        // one walk up the hierarchy, each ancestor looked up in the set
+        for(ObjectRef class = context->except->class; class != NULL;
+            class = class->parent){
+            for(ObjectRef const *member = set; *member != NULL; member++){
+                if(class == *member ||
+                    ((*member)->id != 0 && class->id == (*member)->id)){
+                    exhcatch_commit(context);
+                    return 1;
+                }
+            }
+        }
+    }
+
+    return context->except->state == CAUGHT_STATE;
+}
+
+// -- 95
+int exhcatch_if(
+    Context *context, ObjectRef object, exh_predicateFn predicate
+){
+    exhprint_debug(context, "exhcatch_if");
+    if(context == NULL){
+        context = exhget_context(NULL);
+    }
+    if(context->except->state == PENDING_STATE &&
+        exhis_derived(context->except->class, object) &&
+        predicate(context->except->data)
+    ){
+        exhcatch_commit(context);
     }
 
     return context->except->state == CAUGHT_STATE;
 }
 
+// -----------------------------------------------------------------
+// exhcontext_drop() :: the outermost 'try' is done, its stack (with
+// threads, its context) is unpublished before a signal could find it freed
+// -----------------------------------------------------------------
+static void exhcontext_drop(Context *context){
+    Stack *stack = context->stack;
+    if(EXHANDLER_MULTI_THREADING){
+        threadContext = NULL;
+        __atomic_signal_fence(__ATOMIC_SEQ_CST);
+        EXHANDLER_THREAD_MUTEX_FUNC(1);
+        free(dict_remove(contextDict, EXHANDLER_THREAD_ID_FUNC()));
+        EXHANDLER_THREAD_MUTEX_FUNC(0);
+    }else{
+        context->stack = NULL;
+        __atomic_signal_fence(__ATOMIC_SEQ_CST);
+    }
+    stack_delete(stack);
+}
+
 // -- 46
 int exhfinally(Context *context){
-    ExceptionType *except;
-    ExceptionType self;
+    ExceptionType *self;
 
     if(context == NULL){ context = exhget_context(NULL); }
+    EXH_BUSY_BEGIN(context);
 
-    self = *(except = stack_pop(context->stack));
-    free(except);
-    context->except=stack_len(context->stack) ? stack_peek(context->stack) : 0;
+    EXH_PROBE(
+        finally_begin,
+        context->except->state == PENDING_STATE ?
+            context->except->class->name : NULL,
+        context->except->tryfile, context->except->trylineno,
+        stack_len(context->stack)
+    );
+    // on the spare list it stays intact until the outermost frame is popped
+    self = stack_pop(context->stack);
+    self->next = context->spare;
+    context->spare = self;
+#ifdef DEBUG
+    // left behind when another thread finished checking the site first
+    if(self->checklist != NULL){
+        list_delete_with_data(self->checklist);
+        self->checklist = NULL;
+    }
+#endif
+    exhregistry_pop();
+#ifdef EXHANDLER_DEADLINE
+    if(self->deadline != deadlineActive){ exhdeadline_set(self->deadline); }
+#endif
+    context->except = stack_len(context->stack) ?
+        stack_peek(context->stack, 1) : 0;
     if(stack_len(context->stack) == 0){
+        // the empty stack keeps the signals out from here on
+        EXH_BUSY_END(context);
+        State state = self->state;
+        ObjectRef class = self->class;
+        void *data = self->data;
+        char *filename = self->filename;
+        int lineno = self->lineno;
+        unsigned long long throwtime = self->throwtime;
+        ExceptionCause causes[EXH_CAUSE_DEPTH];
+        int ncauses = self->ncauses;
         int restored = exhresore_handlers(context);
-        if(self.state = PENDING_STATE){
-            if(self.class == FailedAssertionError){
+        int recorded = 0;
+        if(ncauses > 0){
+            memcpy(causes, self->causes, ncauses * sizeof(ExceptionCause));
+        }
+        // the spare frames only serve nested 'try' blocks
+        exhdelete_spares(context);
+        if(state == PENDING_STATE){
+            if(class != ReturnEvent){
+                exhstats_lost(class);
+                exhlatency_record(class, throwtime, 1);
+                exhflight_record(
+                    EXH_EVENT_LOST, class, filename, lineno,
+                    NULL
+                );
+                if(class != FailedAssertionError){
+                    recorded = exhevent_record(
+                        EXH_EVENT_LOST, class, filename,
+                        lineno, NULL, 0
+                    );
+                }
+            }
+            if(class == FailedAssertionError){
                 exhhandle_assertion(
-                    context, EXH_ABORT, self.data, self.filename, self.lineno
+                    context, EXH_ABORT, data, filename, lineno
                 );
             }
-            else if(exhis_derived(self.class, RuntimeError) && restored){
-                stack_delete(context->stack);
-                if(EXHANDLER_MULTI_THREADING){
-                    EXHANDLER_THREAD_MUTEX_FUNC(1);
-                    free(dict_remove(contextDict, EXHANDLER_THREAD_ID_FUNC()));
-                    EXHANDLER_THREAD_MUTEX_FUNC(0);
-                }else{
-                    context->stack = NULL;
-                }
-                raise(self.class->signum);
-            }else if(self.class == ReturnEvent){
-                stack_delete(context->stack);
-                if(EXHANDLER_MULTI_THREADING){
-                    EXHANDLER_THREAD_MUTEX_FUNC(1);
-                    free(dict_remove(contextDict, EXHANDLER_THREAD_ID_FUNC()));
-                    EXHANDLER_THREAD_MUTEX_FUNC(0);
-                }else{
-                    context->stack = NULL;
-                }
-                EXH_LONGJMP(*(EXH_JMP_BUF*)self.data, 1);
-            }else{
+            else if(exhis_derived(class, RuntimeError) && restored){
+                exhcontext_drop(context);
+                raise(class->signum);
+            }else if(class == ReturnEvent){
+                exhcontext_drop(context);
+                EXH_LONGJMP(*(EXH_JMP_BUF*)data, 1);
+            }else if(!recorded){
                 fprintf(
                     stderr, "%s lost: file \"%s\", line %d.\n",
-                    self.class->name, self.filename, self.lineno
+                    class->name, filename, lineno
                 );
+                for(int i=0; i < ncauses; i++){
+                    fprintf(
+                        stderr, "      caused by %s: file \"%s\", line %d\n",
+                        causes[i].class->name, causes[i].filename,
+                        causes[i].lineno
+                    );
+                }
             }
         }
-        stack_delete(context->stack);
-        if(EXHANDLER_MULTI_THREADING){
-            EXHANDLER_THREAD_MUTEX_FUNC(1);
-            free(dict_remove(contextDict, EXHANDLER_THREAD_ID_FUNC()));
-            EXHANDLER_THREAD_MUTEX_FUNC(0);
-        }else{ context->stack = NULL; }
+        exhcontext_drop(context);
     }else{
-        if(self.state == PENDING_STATE){
-            if(self.class == ReturnEvent && self.first){
-                EXH_LONGJMP(*(EXH_JMP_BUF*)self.data, 1);
+        if(self->state == PENDING_STATE){
+            if(self->class == ReturnEvent && self->first){
+                EXH_BUSY_END(context);
+                EXH_LONGJMP(*(EXH_JMP_BUF*)self->data, 1);
             }else{
-                exhthrow(
-                    context, self.class, self.data, self.filename, self.lineno
-                );
+                exhpropagate(context, self);
             }
         }
+        EXH_BUSY_END(context);
     }
 
     return 0;
@@ -557,8 +3621,10 @@ void exhreturn(Context *context){
     if(context == NULL){
         context = exhget_context(NULL);
     }
+    EXH_BUSY_BEGIN(context);
     context->except->class = ReturnEvent;
     context->except->state = PENDING_STATE;
+    EXH_BUSY_END(context);
     exhprint_debug(context, "longjmp(finalbuf)");
 
     EXH_LONGJMP(context->except->finalbuf, 1);
@@ -589,41 +3655,55 @@ int exhcheck_begin(
     return *checked;
 }
 
+typedef struct Check{
+    ObjectRef objref;
+    int lineno;
+} Check;
+
+// ---
+// exhcheck_prior() :: report the first earlier clause that already catches
+// 'object', return NULL when there is none
+// ---
+static Check* exhcheck_prior(
+    Context *context, ObjectRef object, char *filename, int lineno
+){
+    Check *check;
+    check = list_get_head(context->except->checklist);
+    while(check != NULL){
+        if(object == check->objref){
+            fprintf(
+                stderr,
+                "Duplicate catch/%s): file \"%s\", line %d; "
+                "already caught at line %d.\n",
+                object->name, filename, lineno, check->lineno
+            );
+            break;
+        }
+        if(exhis_derived(object, check->objref)){
+            fprintf(
+                stderr, "Superfluous catch(%s): file \"%s\", line %d; "
+                "already caught by %s at line %d.\n",
+                object->name, filename, lineno, check->objref->name,
+                check->lineno
+            );
+            break;
+        }
+        check = list_get_next(context->except->checklist);
+    }
+
+    return check;
+}
+
 // -- 49
 int exhcheck(
     Context *context, int *checked, ObjectRef object, char *filename, int lineno
 ){
-    typedef struct Check{
-        ObjectRef objref;
-        int lineno;
-    } Check;
     exhprint_debug(context, "exhcheck");
     if(!*checked){
         Check *check;
-        check = list_get_head(context->except->checklist);
-        while(check != NULL){
-            if(object == check->objref){
-                fprintf(
-                    stderr,
-                    "Duplicate catch/%s): file \"%s\", line %d; "
-                    "already caught at line %d.\n",
-                    object->name, filename, lineno, check->lineno
-                );
-                break;
-            }
-            if(exhis_derived(object, check->objref)){
-                fprintf(
-                    stderr, "Superfluous catch(%s): file \"%s\", line %d; "
-                    "already caught by %s at line %d.\n",
-                    object->name, lineno, check->objref->name, check->lineno
-                );
-                break;
-            }
-            check = list_get_next(context->except->checklist);
-        }
-
+        check = exhcheck_prior(context, object, filename, lineno);
         if(check == NULL){
-            check = malloc(sizeof(check));
+            check = malloc(sizeof(*check));
             check->objref = object;
             check->lineno = lineno;
             list_append(context->except->checklist, check);
@@ -633,3 +3713,27 @@ int exhcheck(
     return *checked;
 }
 
+// -- 96
+int exhcheck_any(
+    Context *context, int *checked, ObjectRef const *set,
+    char *filename, int lineno
+){
+    for(; *set != NULL; set++){
+        exhcheck(context, checked, *set, filename, lineno);
+    }
+
+    return *checked;
+}
+
+// -- 106
+int exhcheck_if(
+    Context *context, int *checked, ObjectRef object, char *filename, int lineno
+){
+    exhprint_debug(context, "exhcheck_if");
+    if(!*checked){
+        exhcheck_prior(context, object, filename, lineno);
+    }
+
+    return *checked;
+}
+
@@ -14,7 +14,6 @@ typedef struct ListNode ListNode;
 typedef struct List List;
 typedef struct Dict Dict;
 typedef struct Type *ObjectRef;
-typedef struct Type Object; //[1];
 typedef struct ExceptionType ExceptionType;
 typedef struct Context Context;
 typedef enum Scope Scope;
@@ -388,6 +387,18 @@ int dict_len(Dict *dict);
 #define exh_mem_malloc(size) exhmem_malloc(cptr, size, __FILE__, __LINE__)
 #define exh_mem_realloc(p, size) exhmem_realloc(\
     cptr, p, size, __FILE__, __LINE__)
+#define exh_mem_free(p) exhmem_free(cptr, p, __FILE__, __LINE__)
+#define exh_mem_calloc_size(n, size) exhmem_calloc_size(\
+    cptr, n, size, __FILE__, __LINE__)
+#define exh_mem_malloc_size(size) exhmem_malloc_size(\
+    cptr, size, __FILE__, __LINE__)
+#define exh_mem_realloc_size(p, size) exhmem_realloc_size(\
+    cptr, p, size, __FILE__, __LINE__)
+#define exh_mem_aligned(alignment, size) exhmem_aligned_alloc(\
+    cptr, alignment, size, __FILE__, __LINE__)
+#define exh_mem_pool_alloc(size) exhmem_pool_alloc(\
+    cptr, size, __FILE__, __LINE__)
+#define exh_mem_pool_free(p) exhmem_pool_free(cptr, p)
 
 /**
  * @brief Allocate a clean memory segment
@@ -427,6 +438,215 @@ void* exhmem_malloc(
 void* exhmem_realloc(
     Context *cptr, void *mem, int size, char *filename, int lineno);
 
+/**
+ * @brief Release a memory segment allocated by exhmem_* routines.
+ *
+ * Using this routine instead of free() keeps the live bytes of the heap
+ * profiler accurate when it is enabled.
+ *
+ * @param cptr      Pointer to thread exception context
+ * @param mem       Pointer to the memory segment
+ * @param filename  Name of source file name where the called was made
+ * @param lineno    Sourfe file line number.
+ */
+void exhmem_free(Context *cptr, void *mem, char *filename, int lineno);
+
+/**
+ * @brief Allocate a clean memory segment of num * size bytes.
+ *
+ * Unlike exhmem_calloc() the sizes are not truncated to int and the
+ * multiplication is checked: an overflow throws OutOfMemoryError.
+ *
+ * @param cptr      Pointer to thread exception context
+ * @param num       Number of elements
+ * @param size      Size of one element.
+ * @param filename  Name of source file name where the called was made
+ * @param lineno    Sourfe file line number.
+ * @return void*    Pointer to allocated memory
+ */
+void* exhmem_calloc_size(
+    Context *cptr, size_t num, size_t size, char *filename, int lineno);
+
+/**
+ * @brief Allocate a memory segment of size bytes.
+ *
+ * @param cptr      Pointer to thread exception context
+ * @param size      Size of the segment.
+ * @param filename  Name of source file name where the called was made
+ * @param lineno    Sourfe file line number.
+ * @return void*    Pointer to allocated memory
+ */
+void* exhmem_malloc_size(
+    Context *cptr, size_t size, char *filename, int lineno);
+
+/**
+ * @brief Change the size of previously allocated memory segment.
+ *
+ * @param cptr      Pointer to thread exception context
+ * @param mem       Pointer to original block
+ * @param size      New size of the segment.
+ * @param filename  Name of source file name where the called was made
+ * @param lineno    Sourfe file line number.
+ * @return void*    Pointer to allocated memory
+ */
+void* exhmem_realloc_size(
+    Context *cptr, void *mem, size_t size, char *filename, int lineno);
+
+/**
+ * @brief Allocate a memory segment aligned on the given boundary.
+ *
+ * The alignment must be a power of two, it is raised to sizeof(void*) when
+ * smaller. The segment is released with free() or exhmem_free().
+ *
+ * @param cptr      Pointer to thread exception context
+ * @param alignment Alignment in bytes (e.g. 32 or 64 for SIMD buffers)
+ * @param size      Size of the segment.
+ * @param filename  Name of source file name where the called was made
+ * @param lineno    Sourfe file line number.
+ * @return void*    Pointer to allocated memory
+ */
+void* exhmem_aligned_alloc(
+    Context *cptr, size_t alignment, size_t size, char *filename, int lineno);
+
+#ifndef EXH_POOL_MAX_SIZE
+#define EXH_POOL_MAX_SIZE   256     /* largest pooled size, multiple of 16 */
+#endif
+#ifndef EXH_POOL_CHUNK_SIZE
+#define EXH_POOL_CHUNK_SIZE (64 * 1024)
+#endif
+
+/**
+ * @brief Allocate a small memory segment from the thread size-class pool.
+ *
+ * Sizes up to EXH_POOL_MAX_SIZE are rounded up to a multiple of 16 and
+ * served from a free list of the calling thread without locking; larger
+ * sizes go to malloc(). Pooled memory is never returned to the system, it
+ * is recycled by later pool allocations. The segment must be released with
+ * exhmem_pool_free().
+ *
+ * @param cptr      Pointer to thread exception context
+ * @param size      Size of the segment.
+ * @param filename  Name of source file name where the called was made
+ * @param lineno    Sourfe file line number.
+ * @return void*    Pointer to allocated memory (16 bytes aligned)
+ */
+void* exhmem_pool_alloc(
+    Context *cptr, size_t size, char *filename, int lineno);
+
+/**
+ * @brief Release a segment allocated with exhmem_pool_alloc().
+ *
+ * The segment may be released by any thread, it is then recycled by the
+ * pool of the releasing thread.
+ *
+ * @param cptr      Pointer to thread exception context
+ * @param mem       Pointer to the memory segment
+ */
+void exhmem_pool_free(Context *cptr, void *mem);
+
+// -- heap profiler api --
+
+#ifndef EXH_PROFILE_INTERVAL
+#define EXH_PROFILE_INTERVAL    (512 * 1024)
+#endif
+
+/**
+ * @brief Start sampling exhmem_* allocations.
+ *
+ * Allocations are sampled with a Poisson process over the allocated bytes:
+ * on average one sample is taken every 'interval' bytes. Every sample is
+ * weighted so that the per call site totals are unbiased estimates.
+ * The profiler is only available when the library is compiled with the
+ * EXHANDLER_HEAP_PROFILE flag.
+ *
+ * @param interval  Mean sampling interval in bytes, 0 for the default.
+ * @return int      1 if the profiler is running, 0 otherwise
+ */
+int exhprof_start(size_t interval);
+
+/**
+ * @brief Stop sampling allocations.
+ *
+ * The collected data is kept and can still be dumped.
+ */
+void exhprof_stop(void);
+
+/**
+ * @brief Print live and total bytes per allocation site.
+ *
+ * The per thread tables are merged and sites are ordered by live bytes.
+ *
+ * @param fileptr   Output stream, stderr if NULL.
+ */
+void exhprof_dump(FILE *fileptr);
+
+/**
+ * @brief Dump the heap profile when the process exits.
+ *
+ * @param filename  Output file name, stderr if NULL.
+ */
+void exhprof_dump_at_exit(char *filename);
+
+// -- emergency reserve api --
+
+/* process reserve set up by the first 'try', see exhmem_set_reserve() */
+#ifndef EXH_RESERVE_DEFAULT_SIZE
+#define EXH_RESERVE_DEFAULT_SIZE    (64 * 1024)
+#endif
+
+/**
+ * @brief Hook invoked when the emergency reserve is released.
+ *
+ * The hook runs in the thread that ran out of memory, after the reserve was
+ * given back to the heap and just before OutOfMemoryError is thrown. It
+ * receives the number of bytes that were released.
+ */
+typedef void (*exh_reserveFn)(size_t);
+
+/**
+ * @brief Set the process wide emergency memory reserve.
+ *
+ * The reserve is a block of memory kept aside and released when an
+ * OutOfMemoryError is about to be thrown, so that 'catch' and 'finally'
+ * handlers, nested 'try' blocks and diagnostics have heap to work with.
+ * A size of 0 drops the reserve. Until it is called, the first 'try' sets
+ * up a reserve of EXH_RESERVE_DEFAULT_SIZE bytes.
+ *
+ * @param size  Size of the reserve in bytes
+ * @return int  1 if the reserve is in place, 0 otherwise
+ */
+int exhmem_set_reserve(size_t size);
+
+/**
+ * @brief Set the emergency memory reserve of the calling thread.
+ *
+ * The thread reserve is released before the process reserve. In single
+ * threaded builds it behaves like a second process reserve.
+ *
+ * @param size  Size of the reserve in bytes
+ * @return int  1 if the reserve is in place, 0 otherwise
+ */
+int exhmem_set_thread_reserve(size_t size);
+
+/**
+ * @brief Install hook called when the emergency reserve is released.
+ *
+ * @param hookfn    Hook function or NULL to remove the current one.
+ * @return exh_reserveFn The previously installed hook.
+ */
+exh_reserveFn exhmem_set_reserve_hook(exh_reserveFn hookfn);
+
+/**
+ * @brief Refill the released emergency reserve(s).
+ *
+ * This routine is meant to be called once the memory pressure has gone,
+ * e.g. after the service has shed load. Both the process reserve and the
+ * reserve of the calling thread are reallocated to their configured size.
+ *
+ * @return int  1 if all configured reserves are in place, 0 otherwise
+ */
+int exhmem_refill_reserve(void);
+
 
 // -- assertion api --
 
@@ -447,7 +667,7 @@ void* exhmem_realloc(
 
 #define exh_validate(cond, retval)             \
     if(cond){}                                 \
-    else{ assert(e); return (retval); } 
+    else{ assert(cond); return retval; } 
 
 #define exh_check(e, n) \
     if(e){} \
@@ -468,23 +688,50 @@ void* exhmem_realloc(
 void exhhandle_assertion(
     Context *cptr, int flag, char *expr, char *filename, int lineno);
 
+/**
+ * @brief Write the current exception trace to a file descriptor.
+ *
+ * The trace is the same as print_stacktrace() prints, formatted into a
+ * stack buffer and sent with a single write(2). No lock, stdio or heap is
+ * used, so it may be called from a signal handler, including the trap
+ * handlers installed by 'try'. Frames that print_stacktrace() has not
+ * symbolized yet are written as raw addresses.
+ *
+ * @param cptr  Pointer to thread exception context, NULL for the caller's.
+ * @param fd    File descriptor to write to.
+ * @return int  0 on success, -1 if there is no trace or the write failed
+ */
+int exhwrite_stacktrace(Context *cptr, int fd);
+
 // -------------------------------
 // --- exception and other api ---
 // -------------------------------
 
 #define EXH_SETJMP(env)         sigsetjmp(env, 1)
+#define EXH_SIGSETJMP(env, savemask)    sigsetjmp(env, savemask)
 #define EXH_LONGJMP(env, val)   siglongjmp(env, val)
 #define EXH_JMP_BUF             sigjmp_buf
 
+#ifndef EXH_BACKTRACE_DEPTH
+#define EXH_BACKTRACE_DEPTH     16  /* call frames kept per exception */
+#endif
+#ifndef EXH_CAUSE_DEPTH
+#define EXH_CAUSE_DEPTH         4   /* causes kept per exception */
+#endif
+#define EXH_CACHE_LINE          64
+
 
 typedef void (*exh_sighandlerFn)(int);
+typedef int (*exh_predicateFn)(void *data);
 
 struct Type{
     int norethrow;
     ObjectRef parent;
     char *name;
     int signum;
+    int id;         // interned name, 0 until exhclass_register()
 };
+typedef struct Type Object[1];
 
 enum Scope{
     OUTSITE_SCOPE=-1,
@@ -496,43 +743,98 @@ enum Scope{
 
 enum State{ EMPTY_STATE, PENDING_STATE, CAUGHT_STATE };
 
-struct ExceptionType{
-    int norethrown;
-    State state;
-    EXH_JMP_BUF throwbuf;
-    EXH_JMP_BUF finalbuf;
+typedef struct ExceptionCause{
     ObjectRef class;
     void *data;
-    char *filename;
+    char *filename;                 // where the cause was thrown
     int lineno;
+} ExceptionCause;
+
+struct ExceptionType{
+    // first line: read or written by every block; volatile, signal
+    // handlers read them (see exhasync_safe()) and a runaway 'try' body
+    // must not leave its scope store behind
+    volatile State state;
+    volatile Scope scope;
     int ready;
-    Scope scope;
+    int savemask;                   // 0 in try_nosig, mask left alone
     int first;
-    List *checklist;
-    char *tryfile;
+    int lineno;
     int trylineno;
+    int nframes;                    // EXHANDLER_BACKTRACE only
+    ObjectRef class;
+    void *data;
+    ExceptionType *next;            // in Context.spare once popped
+    char *tryfile;
+    // written by the setjmp()s of every block
+    EXH_JMP_BUF throwbuf;
+    EXH_JMP_BUF finalbuf;
+    // set once an exception is dispatched, or in some builds only
+    char *filename;
+    unsigned long long throwtime;
+    unsigned long long deadline;    // in force outside, EXHANDLER_DEADLINE
+    List *checklist;                // DEBUG only
+    void **frames;                  // EXHANDLER_BACKTRACE only, side storage
+    ExceptionCause *causes;         // throw_with_cause(), side storage
+    int ncauses;                    // direct cause first
+    int norethrown;
+    int rethrown;                   // by exh_rethrow(), its catch counted
     ObjectRef (*get_class)(void);
     char* (*get_description)(void); // getMessage
     void* (*get_data)(void);
     void (*print_stacktrace)(FILE *);
-};
+} __attribute__((aligned(EXH_CACHE_LINE)));
 
 struct Context{
     ExceptionType *except;
     Stack *stack;
-    char description[1024];
-    exh_sighandlerFn aborthandler;
-    exh_sighandlerFn fpehandler;
-    exh_sighandlerFn illhandler;
-    exh_sighandlerFn segvhandler;
-    exh_sighandlerFn bushandler;
+    ExceptionType *spare;           // popped frames, reused by 'try'
+    int trapping;                   // trap handlers installed by a 'try'
+    volatile int busy;              // in library code, see EXH_BUSY_BEGIN
+    volatile ObjectRef cancel;      // exception injected by exhcancel()
+    unsigned long thread;           // owner pthread_t, for exhcancel()
+    // saved by the 'try' that installed the trap handlers
+    struct sigaction abortaction;
+    struct sigaction fpeaction;
+    struct sigaction illaction;
+    struct sigaction segvaction;
+    struct sigaction busaction;
 };
 
 extern Context *cptr;
+#if defined(EXHANDLER_SHARED_MEMORY) || defined(EXHANDLER_PRIVATE_MEMORY)
+extern __thread Context *exhcurrent_context;
+#else
+extern Context *exhcurrent_context;
+#endif
+
+/*
+ * Library code an asynchronous exception (exhcancel() with async, an
+ * expired deadline) must not cut short is bracketed by these: the signal
+ * then leaves the exception for later. Throwing resets the count, the
+ * code it jumps to is never inside the library.
+ */
+#define EXH_BUSY_BEGIN(context) do{                 \
+        Context *busyc = (context);                 \
+        if(busyc != NULL){                          \
+            busyc->busy++;                          \
+            __atomic_signal_fence(__ATOMIC_SEQ_CST);\
+        }                                           \
+    }while(0)
+
+#define EXH_BUSY_END(context) do{                   \
+        Context *busyc = (context);                 \
+        if(busyc != NULL){                          \
+            __atomic_signal_fence(__ATOMIC_SEQ_CST);\
+            busyc->busy--;                          \
+        }                                           \
+    }while(0)
+
 extern Object Throwable;
 
 #define EXH_DECLARE(self, master)   extern Object self
-#define EXH_DEFINE(self, master)    Object self = {1, master, #self }
+#define EXH_DEFINE(self, master)    Object self = {{1, master, #self }}; \
+    EXH_SITE_DEFINE(self, master)
 
 EXH_DECLARE(Exception, Throwable);
 EXH_DECLARE(OutOfMemoryError, Exception);
@@ -543,70 +845,295 @@ EXH_DECLARE(ArithmethicError, RuntimeError);            /* SIGFPE */
 EXH_DECLARE(IllegalInstructionError, RuntimeError);     /* SIGABRT */
 EXH_DECLARE(SegmentationError, RuntimeError);           /* SIGABRT */
 EXH_DECLARE(BusError, RuntimeError);                    /* SIGABRT */
+EXH_DECLARE(AggregateError, Exception);                 /* AggregateData */
+EXH_DECLARE(TimeoutError, Exception);                   /* try_deadline */
 
 
 #ifdef DEBUG
+/*
+ * The catch clauses of a site are checked on its first run only, 'checked'
+ * caches the result: from then on a check is one load and no call.
+ */
 #define EXH_CHECKED static int checked
 #define EXH_CHECK_BEGIN(ptr, flag, file, linenum) \
-    exhcheck_begin(ptr, flag, file, linenum)
+    (*(flag) || exhcheck_begin(ptr, flag, file, linenum))
 
 #define EXH_CHECK(ptr, flag, obj, file, linenum)    \
-    exhcheck(ptr, flag, obj, file, linenum)
+    (*(flag) || exhcheck(ptr, flag, obj, file, linenum))
 
-#define EXH_CHECK_ENND  !checked
+#define EXH_CHECK_ANY(ptr, flag, set, file, linenum)    \
+    (*(flag) || exhcheck_any(ptr, flag, set, file, linenum))
+
+#define EXH_CHECK_IF(ptr, flag, obj, file, linenum)    \
+    (*(flag) || exhcheck_if(ptr, flag, obj, file, linenum))
+
+#define EXH_CHECK_END  !checked
 #else
 #define EXH_CHECKED 
 #define EXH_CHECK_BEGIN(ptr, flag, file, linenum)   1
 #define EXH_CHECK(ptr, flag, obj, file, linenum)    1
+#define EXH_CHECK_ANY(ptr, flag, set, file, linenum)    1
+#define EXH_CHECK_IF(ptr, flag, obj, file, linenum)     1
 #define EXH_CHECK_END                               0
 #endif /* DEBUG */
 
+/*
+ * With EXHANDLER_SITE_TABLE every 'try', 'catch', 'throw' and EXH_DEFINE
+ * leaves a SiteRecord in the EXH_SITE_SECTION section of the object file.
+ * tools/exhladder.c reads them back and checks the catch clauses without
+ * running the program. Records hold no pointers, so they need no
+ * relocation and read the same from objects, executables and libraries.
+ * A source path longer than SiteRecord.filename, or a caught or defined
+ * class name longer than SiteRecord.class, fails the compilation rather
+ * than being cut short. A catch_any() leaves one record per class, it
+ * takes at most 16 classes then. A catch names its 'try' by the line of
+ * the 'try', the same in every file that includes it from a header;
+ * __COUNTER__ differs between those files, so it only orders the 'try's
+ * and the catches a macro puts on one line.
+ */
+#define EXH_SITE_SECTION    "exhsites"
+#define EXH_SITE_TRY        1
+#define EXH_SITE_CATCH      2
+#define EXH_SITE_THROW      3
+#define EXH_SITE_CLASS      4
+#define EXH_SITE_CATCH_IF   5
+
+typedef struct SiteRecord{
+    int kind;                       // EXH_SITE_*
+    int lineno;
+    int site;                       // line of the 'try' a catch belongs to
+    int ordinal;                    // tells the 'try's of one line apart
+    int order;                      // orders the catches of one line
+    int index;                      // class position in a catch_any()
+    char class[48];                 // caught, thrown or defined class
+    char parent[48];                // EXH_SITE_CLASS only
+    char filename[392];             // __FILE__, the whole path
+} SiteRecord;
+
+#ifdef EXHANDLER_SITE_TABLE
+#define EXH_SITE_RECORD(var, kind, class, parent)                       \
+    EXH_SITE_RECORD_AT(var, kind, 0, 0, 0, class, parent)
+
+#define EXH_SITE_RECORD_AT(var, kind, site, ordinal, index, class, parent) \
+    _Static_assert(                                                     \
+        sizeof(__FILE__) <= sizeof(((SiteRecord*)0)->filename),         \
+        "EXHANDLER_SITE_TABLE: path too long for SiteRecord.filename"   \
+    );                                                                  \
+    static const SiteRecord var                                         \
+    __attribute__((section(EXH_SITE_SECTION), used, aligned(64))) =     \
+    {kind, __LINE__, site, ordinal, __COUNTER__, index, class, parent,  \
+        __FILE__}
+
+#define EXH_SITE_NAME_FITS(name)                                        \
+    _Static_assert(                                                     \
+        sizeof(name) <= sizeof(((SiteRecord*)0)->class),                \
+        "EXHANDLER_SITE_TABLE: class name too long for SiteRecord.class"\
+    )
+
+#define EXH_SITE_TRY_BLOCK                                              \
+    enum{ exhsite = __LINE__, exhsite_ordinal = __COUNTER__ };          \
+    EXH_SITE_RECORD_AT(                                                 \
+        exhsite_try, EXH_SITE_TRY, exhsite, exhsite_ordinal, 0, "", ""  \
+    )
+
+// one record per class, 'n' counts down and names it, 'i' counts up
+#define EXH_SITE_CATCH_CLAUSE(...)                                      \
+    EXH_SITE_CAT(EXH_SITE_CATCH_, EXH_SITE_NARGS(__VA_ARGS__))(0, __VA_ARGS__)
+
+#define EXH_SITE_CAT(a, b)      EXH_SITE_CAT_(a, b)
+#define EXH_SITE_CAT_(a, b)     a##b
+#define EXH_SITE_NARGS(...)     EXH_SITE_NARGS_(__VA_ARGS__,            \
+    16, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1)
+#define EXH_SITE_NARGS_(_1, _2, _3, _4, _5, _6, _7, _8, _9, _10, _11,   \
+    _12, _13, _14, _15, _16, n, ...)    n
+
+#define EXH_SITE_CATCH_ONE(n, i, obj)                                   \
+    EXH_SITE_NAME_FITS(#obj);                                           \
+    EXH_SITE_RECORD_AT(                                                 \
+        exhsite_catch_##n, EXH_SITE_CATCH, exhsite, exhsite_ordinal, i, \
+        #obj, ""                                                        \
+    )
+#define EXH_SITE_CATCH_1(i, obj)                                        \
+    EXH_SITE_CATCH_ONE(1, i, obj)
+#define EXH_SITE_CATCH_2(i, obj, ...)                                   \
+    EXH_SITE_CATCH_ONE(2, i, obj); EXH_SITE_CATCH_1(i + 1, __VA_ARGS__)
+#define EXH_SITE_CATCH_3(i, obj, ...)                                   \
+    EXH_SITE_CATCH_ONE(3, i, obj); EXH_SITE_CATCH_2(i + 1, __VA_ARGS__)
+#define EXH_SITE_CATCH_4(i, obj, ...)                                   \
+    EXH_SITE_CATCH_ONE(4, i, obj); EXH_SITE_CATCH_3(i + 1, __VA_ARGS__)
+#define EXH_SITE_CATCH_5(i, obj, ...)                                   \
+    EXH_SITE_CATCH_ONE(5, i, obj); EXH_SITE_CATCH_4(i + 1, __VA_ARGS__)
+#define EXH_SITE_CATCH_6(i, obj, ...)                                   \
+    EXH_SITE_CATCH_ONE(6, i, obj); EXH_SITE_CATCH_5(i + 1, __VA_ARGS__)
+#define EXH_SITE_CATCH_7(i, obj, ...)                                   \
+    EXH_SITE_CATCH_ONE(7, i, obj); EXH_SITE_CATCH_6(i + 1, __VA_ARGS__)
+#define EXH_SITE_CATCH_8(i, obj, ...)                                   \
+    EXH_SITE_CATCH_ONE(8, i, obj); EXH_SITE_CATCH_7(i + 1, __VA_ARGS__)
+#define EXH_SITE_CATCH_9(i, obj, ...)                                   \
+    EXH_SITE_CATCH_ONE(9, i, obj); EXH_SITE_CATCH_8(i + 1, __VA_ARGS__)
+#define EXH_SITE_CATCH_10(i, obj, ...)                                  \
+    EXH_SITE_CATCH_ONE(10, i, obj); EXH_SITE_CATCH_9(i + 1, __VA_ARGS__)
+#define EXH_SITE_CATCH_11(i, obj, ...)                                  \
+    EXH_SITE_CATCH_ONE(11, i, obj); EXH_SITE_CATCH_10(i + 1, __VA_ARGS__)
+#define EXH_SITE_CATCH_12(i, obj, ...)                                  \
+    EXH_SITE_CATCH_ONE(12, i, obj); EXH_SITE_CATCH_11(i + 1, __VA_ARGS__)
+#define EXH_SITE_CATCH_13(i, obj, ...)                                  \
+    EXH_SITE_CATCH_ONE(13, i, obj); EXH_SITE_CATCH_12(i + 1, __VA_ARGS__)
+#define EXH_SITE_CATCH_14(i, obj, ...)                                  \
+    EXH_SITE_CATCH_ONE(14, i, obj); EXH_SITE_CATCH_13(i + 1, __VA_ARGS__)
+#define EXH_SITE_CATCH_15(i, obj, ...)                                  \
+    EXH_SITE_CATCH_ONE(15, i, obj); EXH_SITE_CATCH_14(i + 1, __VA_ARGS__)
+#define EXH_SITE_CATCH_16(i, obj, ...)                                  \
+    EXH_SITE_CATCH_ONE(16, i, obj); EXH_SITE_CATCH_15(i + 1, __VA_ARGS__)
+
+#define EXH_SITE_CATCH_IF_CLAUSE(obj)                                   \
+    EXH_SITE_NAME_FITS(#obj);                                           \
+    EXH_SITE_RECORD_AT(                                                 \
+        exhsite_catch, EXH_SITE_CATCH_IF, exhsite, exhsite_ordinal, 0,  \
+        #obj, ""                                                        \
+    )
+
+#define EXH_SITE_THROW_CALL(obj, call)                                  \
+    ({ EXH_SITE_RECORD(exhsite_throw, EXH_SITE_THROW, #obj, ""); call; })
+
+#define EXH_SITE_DEFINE(self, master)                                   \
+    EXH_SITE_NAME_FITS(#self);                                          \
+    EXH_SITE_NAME_FITS(#master);                                        \
+    EXH_SITE_RECORD(                                                    \
+        exhsite_class_##self, EXH_SITE_CLASS, #self, #master            \
+    )
+#else
+#define EXH_SITE_TRY_BLOCK
+#define EXH_SITE_CATCH_CLAUSE(...)
+#define EXH_SITE_CATCH_IF_CLAUSE(obj)
+#define EXH_SITE_THROW_CALL(obj, call)              call
+#define EXH_SITE_DEFINE(self, master)               \
+    extern Object self
+#endif /* EXHANDLER_SITE_TABLE */
+
 #define exh_thread_cleanump(tid) exhthread_cleanup(tid)
 
 #define try                                     \
+    EXH_TRY(cptr, __FILE__, __LINE__);          \
+    EXH_TRY_BLOCK
+
+#define try_nosig                               \
+    EXH_TRY_NOSIG(cptr, __FILE__, __LINE__);    \
+    EXH_TRY_BLOCK
+
+/*
+ * try_deadline() throws TimeoutError asynchronously, from wherever its body
+ * is when the deadline expires: only use it around code that holds no
+ * locks and allocates with exh_mem_* alone, or makes no libc call at all.
+ */
+#define try_deadline(ns)                        \
     exhtry(cptr, __FILE__, __LINE__);           \
+    exhdeadline(cptr, ns);                      \
+    EXH_TRY_BLOCK
+
+#define EXH_TRY_BLOCK                           \
     while(1){                                   \
-        Context *tmpc = exhget_context(cptr);   \
+        Context *tmpc = EXH_CONTEXT(cptr);      \
         Context *cptr = tmpc;                   \
         EXH_CHECKED;                            \
+        EXH_SITE_TRY_BLOCK;                     \
         if(EXH_CHECK_BEGIN(cptr, &checked, __FILE__, __LINE__) && \
-            cptr->except->ready && EXH_SETJMP(cptr->except->throwbuf)==0) \
+            cptr->except->ready &&              \
+            EXH_SIGSETJMP(cptr->except->throwbuf, cptr->except->savemask)==0) \
         {                                       \
             cptr->except->scope = TRY_SCOPE;    \
             do{
 
 #define catch(obj, e) }while(0);                                    \
     }else if(EXH_CHECK(cptr, &checked, obj, __FILE__, __LINE__) &&  \
-        cptr->except->read && exhcatch(cptr, obj))                  \
+        cptr->except->ready && EXH_CATCH(cptr, obj))                \
     {                                                               \
-        ExceptionType *except = stack_peek(cptr->stack, 1);         \
+        ExceptionType *e __attribute__((unused)) =                  \
+            stack_peek(cptr->stack, 1);                             \
+        EXH_SITE_CATCH_CLAUSE(obj);                                 \
         cptr->except->scope = CATCH_SCOPE;                          \
         do{
 
+/*
+ * catch_any() catches any of the classes listed, walking the hierarchy of
+ * the exception once; the set is a static array built once per clause.
+ * catch_if() catches 'obj' only when predicate(data) holds; otherwise the
+ * exception stays pending for the next clauses.
+ */
+#define catch_any(e, ...) }while(0);                                    \
+    }else if(({                                                         \
+        static ObjectRef const exhset[] = {__VA_ARGS__, NULL};          \
+        EXH_CHECK_ANY(cptr, &checked, exhset, __FILE__, __LINE__) &&    \
+            cptr->except->ready && EXH_CATCH_ANY(cptr, exhset); }))     \
+    {                                                                   \
+        ExceptionType *e __attribute__((unused)) =                      \
+            stack_peek(cptr->stack, 1);                                 \
+        EXH_SITE_CATCH_CLAUSE(__VA_ARGS__);                             \
+        cptr->except->scope = CATCH_SCOPE;                              \
+        do{
+
+#define catch_if(obj, e, predicate) }while(0);                          \
+    }else if(EXH_CHECK_IF(cptr, &checked, obj, __FILE__, __LINE__) &&   \
+        cptr->except->ready && exhcatch_if(cptr, obj, predicate))       \
+    {                                                                   \
+        ExceptionType *e __attribute__((unused)) =                      \
+            stack_peek(cptr->stack, 1);                                 \
+        EXH_SITE_CATCH_IF_CLAUSE(obj);                                  \
+        cptr->except->scope = CATCH_SCOPE;                              \
+        do{
+
 #define finally     } while(0);     \
         }                               \
         if(EXH_CHECK_END){continue;}    \
-        if(!cptr->except->ready && EXH_SETJMP(cptr->except->finalbuf)==0)   \
+        if(!cptr->except->ready &&                                          \
+            EXH_SIGSETJMP(cptr->except->finalbuf, cptr->except->savemask)==0) \
         {cptr->except->ready = 1; }else{ break; }                           \
     }                                                                       \
-    exhget_context(cptr)->except->scope = FINALLY_SCOPE;                    \
-    while(exhget_context(cptr)->except->ready > 0|| exhfinally(cptr))       \
-        while(exhget_context(cptr)->except->ready-- > 0)
+    EXH_CONTEXT(cptr)->except->scope = FINALLY_SCOPE;                       \
+    while(EXH_CONTEXT(cptr)->except->ready > 0 || EXH_FINALLY(cptr))        \
+        while(EXH_CONTEXT(cptr)->except->ready-- > 0)
+
+#define throw(obj, data)    EXH_SITE_THROW_CALL(                \
+    obj, exhthrow(cptr, (ObjectRef)obj, data, __FILE__, __LINE__)   \
+)
+
+#define rethrow(record)     exhrethrow(cptr, record)
+
+/*
+ * throw_with_cause() throws a new exception caused by 'cause', usually the
+ * 'e' of the enclosing catch. The cause and its own causes are kept in
+ * e->causes, direct cause first, at most EXH_CAUSE_DEPTH of them.
+ * exh_rethrow() throws the caught exception again as it is: same throw
+ * site, backtrace and causes, and it is not counted as a new throw.
+ */
+#define throw_with_cause(obj, data, cause)  EXH_SITE_THROW_CALL(     \
+    obj, exhthrow_cause(                                            \
+        cptr, (ObjectRef)obj, data, cause, __FILE__, __LINE__       \
+    )                                                               \
+)
+
+#define exh_rethrow()       exhrethrow_caught(cptr, __FILE__, __LINE__)
+
+#define exh_cancel(thread, cls)     exhcancel(thread, (ObjectRef)cls, 0)
 
-#define throw(obj, data)    \
-    exhthrow(cptr, (ObjectRef)obj, data, __FILE__, __LINE__)
+#define exh_cancel_point() {                                    \
+        Context *cctx = EXH_CONTEXT(cptr);                      \
+        if(cctx != NULL && __builtin_expect(cctx->cancel != NULL, 0)){ \
+            exhcancel_throw(cctx, __FILE__, __LINE__);          \
+        }                                                       \
+    }
 
 #define exh_return(x) {                             \
-        if(exhget_scope(cptr) != OUT_SCOPE){            \
+        if(EXH_SCOPE(cptr) != OUTSITE_SCOPE){       \
             void *data = malloc(sizeof(EXH_JMP_BUF));   \
-            exhget_context(cptr)->except->data = data;  \
+            EXH_CONTEXT(cptr)->except->data = data;     \
             if(EXH_SETJMP(*(EXH_JMP_BUF *)data)==0){ exhreturn(cptr);}\
-            else{ free(cptr);} \
+            else{ free(data);} \
         }\
         return x; \
     }
 
-#define pending     (exhget_context(cptr)->except->state == PENDING_STATE)
+#define pending     (EXH_CONTEXT(cptr)->except->state == PENDING_STATE)
 
 /**
  * @brief Get exception block scope
@@ -640,6 +1167,20 @@ void exhthread_cleanup(int tid);
  */
 void exhtry(Context *context, char *filename, int line);
 
+/**
+ * @brief Prepare for 'try_nosig'
+ *
+ * A 'try_nosig' block does no signal bookkeeping: it neither installs the
+ * trap handlers nor saves and restores the signal mask. Traps are only
+ * turned into exceptions once a plain 'try' of the thread has installed
+ * the handlers, so use it for blocks that cannot fault.
+ *
+ * @param context
+ * @param filename
+ * @param line
+ */
+void exhtry_nosig(Context *context, char *filename, int line);
+
 /**
  * @brief Dispatch exception 'throw' 
  * 
@@ -661,6 +1202,29 @@ void exhthrow(
  */
 int exhcatch(Context *context, ObjectRef exceptObj);
 
+/**
+ * @brief Check if exception can be caught by any class of a set.
+ *
+ * @param context
+ * @param set       NULL terminated classes, see catch_any().
+ * @return int
+ */
+int exhcatch_any(Context *context, ObjectRef const *set);
+
+/**
+ * @brief Check if exception can be caught and its data accepted.
+ *
+ * The exception stays pending when the predicate declines its data.
+ *
+ * @param context
+ * @param object
+ * @param predicate Called with the data given to 'throw'.
+ * @return int
+ */
+int exhcatch_if(
+    Context *context, ObjectRef object, exh_predicateFn predicate
+);
+
 /**
  * @brief Resolve at the end of 'finally'
  * 
@@ -702,4 +1266,845 @@ int exhcheck(
     char *filename, int lineno
 );
 
+/**
+ * @brief Perform the 'catch' condition check of each class of a set
+ *
+ * @param context
+ * @param checked
+ * @param set
+ * @param filename
+ * @param lineno
+ * @return int
+ */
+int exhcheck_any(
+    Context *context, int *checked, ObjectRef const *set,
+    char *filename, int lineno
+);
+
+/**
+ * @brief Perform the 'catch_if' condition check
+ *
+ * The clause is checked against the clauses before it, but is not added
+ * to them: its predicate may decline, so it hides no later clause.
+ *
+ * @param context
+ * @param checked
+ * @param object
+ * @param filename
+ * @param lineno
+ * @return int
+ */
+int exhcheck_if(
+    Context *context, int *checked, ObjectRef object,
+    char *filename, int lineno
+);
+
+// ----------------------------------------------------------------------
+//                          INLINE FAST PATH API
+// ----------------------------------------------------------------------
+
+/**
+ * @brief Reset a frame taken from Context.spare for a new 'try'.
+ *
+ * Only the fields read before an exception is dispatched into the frame
+ * are cleared, the frame is otherwise left as its last 'try' left it.
+ *
+ * @param except    Frame to reset
+ */
+static inline void exhframe_reset(ExceptionType *except){
+    except->state = EMPTY_STATE;
+    except->scope = INTERNAL_SCOPE;
+    except->ready = 0;
+    except->class = NULL;
+    except->data = NULL;
+    except->checklist = NULL;
+    except->nframes = 0;
+    except->ncauses = 0;
+    except->rethrown = 0;
+}
+
+/*
+ * With EXHANDLER_INLINE the nested 'try', the catch matching and the
+ * finally of a frame nothing was thrown into run inline on the calling
+ * thread's context: a 'try' costs the setjmp()s plus a few stores. The
+ * outermost 'try', 'throw' and every exception in flight still go through
+ * exhandler.c. The hooks of the observability and DEBUG builds live
+ * out-of-line, so those builds keep the out-of-line path.
+ */
+#if defined(EXHANDLER_INLINE) && !defined(DEBUG) && \
+    !defined(EXHANDLER_DEBUG) && !defined(EXHANDLER_STATS) && \
+    !defined(EXHANDLER_TIMING) && !defined(EXHANDLER_EVENTS) && \
+    !defined(EXHANDLER_FLIGHT_RECORDER) && !defined(EXHANDLER_REGISTRY) && \
+    !defined(EXHANDLER_USDT) && !defined(EXHANDLER_DEADLINE)
+
+/**
+ * @brief exhget_context() without a call once the thread has a context.
+ */
+static inline Context* exhget_context_inline(Context *cptr){
+    if(cptr == NULL){ cptr = exhcurrent_context; }
+    return cptr != NULL ? cptr : exhget_context(NULL);
+}
+
+/**
+ * @brief exhget_scope() of the innermost 'try', inline.
+ */
+static inline Scope exhget_scope_inline(Context *cptr){
+    if(cptr == NULL){ cptr = exhcurrent_context; }
+    if(cptr == NULL || cptr->except == NULL){ return OUTSITE_SCOPE; }
+    return cptr->except->scope;
+}
+
+/**
+ * @brief exhtry() for a nested 'try' with a spare frame at hand.
+ */
+static inline void exhtry_inline(
+    Context *cptr, char *filename, int lineno, int savemask
+){
+    Context *context = cptr != NULL ? cptr : exhcurrent_context;
+    ExceptionType *except;
+
+    if(context == NULL || context->except == NULL ||
+        (except = context->spare) == NULL ||
+        context->stack->len == context->stack->size ||
+        (savemask && !context->trapping)){
+        if(savemask){ exhtry(cptr, filename, lineno); }
+        else{ exhtry_nosig(cptr, filename, lineno); }
+        return;
+    }
+    EXH_BUSY_BEGIN(context);
+    context->spare = except->next;
+    exhframe_reset(except);
+    except->first = cptr == NULL;
+    except->savemask = savemask;
+    except->tryfile = filename;
+    except->trylineno = lineno;
+    context->stack->data[context->stack->len++] = except;
+    context->except = except;
+    EXH_BUSY_END(context);
+}
+
+/**
+ * @brief exhcatch(), a class that does not match costs no call.
+ */
+static inline int exhcatch_inline(Context *cptr, ObjectRef object){
+    ExceptionType *except = exhget_context_inline(cptr)->except;
+    ObjectRef class;
+
+    if(except->state != PENDING_STATE){ return except->state == CAUGHT_STATE; }
+    for(class = except->class; class != NULL; class = class->parent){
+        if(class == object || (object->id && class->id == object->id)){
+            except->state = CAUGHT_STATE;
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * @brief exhcatch_any(), inline.
+ */
+static inline int exhcatch_any_inline(Context *cptr, ObjectRef const *set){
+    ExceptionType *except = exhget_context_inline(cptr)->except;
+    ObjectRef class;
+
+    if(except->state != PENDING_STATE){ return except->state == CAUGHT_STATE; }
+    for(class = except->class; class != NULL; class = class->parent){
+        for(ObjectRef const *member = set; *member != NULL; member++){
+            if(class == *member ||
+                ((*member)->id && class->id == (*member)->id)){
+                except->state = CAUGHT_STATE;
+                return 1;
+            }
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * @brief exhfinally() of a nested frame with nothing pending, inline.
+ */
+static inline int exhfinally_inline(Context *cptr){
+    Context *context = exhget_context_inline(cptr);
+    ExceptionType *except = context->except;
+    Stack *stack = context->stack;
+
+    if(except->state == PENDING_STATE || stack->len <= 1){
+        return exhfinally(cptr);
+    }
+    EXH_BUSY_BEGIN(context);
+    stack->len--;
+    except->next = context->spare;
+    context->spare = except;
+    context->except = stack->data[stack->len - 1];
+    EXH_BUSY_END(context);
+
+    return 0;
+}
+
+#define EXH_TRY(ptr, file, linenum)     exhtry_inline(ptr, file, linenum, 1)
+#define EXH_TRY_NOSIG(ptr, file, linenum)   \
+    exhtry_inline(ptr, file, linenum, 0)
+#define EXH_CONTEXT(ptr)                exhget_context_inline(ptr)
+#define EXH_SCOPE(ptr)                  exhget_scope_inline(ptr)
+#define EXH_CATCH(ptr, obj)             exhcatch_inline(ptr, obj)
+#define EXH_CATCH_ANY(ptr, set)         exhcatch_any_inline(ptr, set)
+#define EXH_FINALLY(ptr)                exhfinally_inline(ptr)
+#else
+#define EXH_TRY(ptr, file, linenum)     exhtry(ptr, file, linenum)
+#define EXH_TRY_NOSIG(ptr, file, linenum)   exhtry_nosig(ptr, file, linenum)
+#define EXH_CONTEXT(ptr)                exhget_context(ptr)
+#define EXH_SCOPE(ptr)                  exhget_scope(ptr)
+#define EXH_CATCH(ptr, obj)             exhcatch(ptr, obj)
+#define EXH_CATCH_ANY(ptr, set)         exhcatch_any(ptr, set)
+#define EXH_FINALLY(ptr)                exhfinally(ptr)
+#endif /* EXHANDLER_INLINE */
+
+// ----------------------------------------------------------------------
+//                       EXCEPTION STATISTICS API
+// ----------------------------------------------------------------------
+
+#ifndef EXH_STATS_CLASSES
+#define EXH_STATS_CLASSES   64      /* per thread, power of 2 */
+#endif
+#ifndef EXH_STATS_SITES
+#define EXH_STATS_SITES     256     /* per thread, power of 2 */
+#endif
+#define EXH_STATS_DEPTHS    32      /* last bucket counts deeper throws */
+
+typedef struct ClassStats ClassStats;
+typedef struct SiteStats SiteStats;
+typedef struct ExceptionStats ExceptionStats;
+
+struct ClassStats{
+    ObjectRef class;
+    size_t throws;
+    size_t catches;
+    size_t lost;
+    size_t causes;  // times in the cause chain of a thrown exception
+};
+
+struct SiteStats{
+    ObjectRef class;
+    char *filename;
+    int lineno;
+    int caught;     // 0: 'throw' site, 1: 'try' site that caught it
+    size_t count;
+};
+
+struct ExceptionStats{
+    size_t throws;
+    size_t catches;
+    size_t lost;
+    size_t depth[EXH_STATS_DEPTHS];     // try depth at throw time
+    int nclasses;
+    int nsites;
+    int overflow;                       // entries that did not fit
+    ClassStats classes[EXH_STATS_CLASSES];
+    SiteStats sites[EXH_STATS_SITES];
+};
+
+/**
+ * @brief Collect the exception counters of all threads.
+ *
+ * Every thread counts its throws, catches and lost exceptions in its own
+ * table, without locking. This routine reads and merges these tables.
+ * The counters are only maintained when the library is compiled with the
+ * EXHANDLER_STATS flag, otherwise the snapshot is empty.
+ *
+ * @param stats Snapshot to fill.
+ */
+void exhstats_snapshot(ExceptionStats *stats);
+
+/**
+ * @brief Merge a snapshot into another one.
+ *
+ * @param stats Snapshot receiving the counters.
+ * @param other Snapshot to add.
+ */
+void exhstats_merge(ExceptionStats *stats, ExceptionStats *other);
+
+/**
+ * @brief Print a snapshot, busiest classes and sites first.
+ *
+ * @param fileptr   Output stream, stderr if NULL.
+ * @param stats     Snapshot to print.
+ */
+void exhstats_print(FILE *fileptr, ExceptionStats *stats);
+
+// ----------------------------------------------------------------------
+//                      THROW TO CATCH LATENCY API
+// ----------------------------------------------------------------------
+
+#ifndef EXH_LATENCY_CLASSES
+#define EXH_LATENCY_CLASSES     16      /* per thread, power of 2 */
+#endif
+#define EXH_LATENCY_SUBBUCKETS  16      /* per power of two, ~6% precision */
+#define EXH_LATENCY_BUCKETS     592     /* up to 2^40 ns */
+
+typedef struct LatencyHistogram LatencyHistogram;
+
+struct LatencyHistogram{
+    ObjectRef class;
+    size_t count;
+    size_t lost;                // included in count, timed up to exhfinally()
+    unsigned long long min;     // nanoseconds
+    unsigned long long max;
+    unsigned long long sum;
+    size_t buckets[EXH_LATENCY_BUCKETS];
+};
+
+/**
+ * @brief Collect the throw to catch latency histogram of a class.
+ *
+ * When the library is compiled with the EXHANDLER_TIMING flag every throw
+ * is stamped with a monotonic clock and the elapsed time is recorded, per
+ * exception class and per thread, when the exception is caught or reported
+ * lost. This routine merges the histograms of all threads.
+ *
+ * @param class Exception class, NULL to merge all classes.
+ * @param hist  Histogram to fill.
+ */
+void exhlatency_snapshot(ObjectRef class, LatencyHistogram *hist);
+
+/**
+ * @brief Get a percentile of a latency histogram.
+ *
+ * @param hist          Histogram
+ * @param percentile    Percentile in [0, 100], e.g. 99.0
+ * @return unsigned long long Latency in nanoseconds (bucket upper bound)
+ */
+unsigned long long exhlatency_percentile(
+    LatencyHistogram *hist, double percentile);
+
+/**
+ * @brief Print p50/p90/p99/p99.9/max of every exception class.
+ *
+ * @param fileptr   Output stream, stderr if NULL.
+ */
+void exhlatency_print(FILE *fileptr);
+
+// ----------------------------------------------------------------------
+//                       EXCEPTION EVENT RING API
+// ----------------------------------------------------------------------
+
+#ifndef EXH_EVENT_RING_SIZE
+#define EXH_EVENT_RING_SIZE     1024    /* events per thread, power of 2 */
+#endif
+
+#define EXH_EVENT_MAGIC         "EXHEVT1"
+
+enum{ EXH_EVENT_THROW=1, EXH_EVENT_CATCH, EXH_EVENT_LOST, EXH_EVENT_ASSERT };
+enum{ EXH_RECORD_STRING=1, EXH_RECORD_EVENT };
+
+/*
+ * Binary stream layout, native byte order:
+ *
+ *      char magic[8]               EXH_EVENT_MAGIC
+ *      { StringRecord, name[len] | EventRecord }*
+ *
+ * Strings (class names, file names, assertion expressions) are sent once
+ * and referred to by id, id 0 is the empty string.
+ */
+typedef struct StringRecord{
+    unsigned char type;             // EXH_RECORD_STRING
+    unsigned char pad[3];
+    unsigned int id;
+    unsigned int len;
+} StringRecord;
+
+typedef struct EventRecord{
+    unsigned char type;             // EXH_RECORD_EVENT
+    unsigned char kind;             // EXH_EVENT_*
+    unsigned short pad;
+    unsigned int classid;
+    unsigned int fileid;
+    unsigned int detailid;
+    int lineno;
+    int depth;
+    int thread;
+    unsigned int pad2;
+    unsigned long long timestamp;   // CLOCK_REALTIME, nanoseconds
+} EventRecord;
+
+/**
+ * @brief Start recording exception events into the per thread rings.
+ *
+ * Once recording, throws, catches, lost exceptions and failed assertions
+ * are stored as compact binary events in a lock-free ring of the calling
+ * thread, and lost exceptions and failed assertions are no longer printed
+ * to stderr. The stream header is written to fd right away. Events are
+ * only recorded when the library is compiled with EXHANDLER_EVENTS.
+ *
+ * @param fd    File descriptor receiving the binary stream.
+ * @return int  1 on success, 0 otherwise
+ */
+int exhevent_open(int fd);
+
+/**
+ * @brief Write the pending events of all threads to the stream.
+ *
+ * Only one drain runs at a time, concurrent calls return immediately.
+ *
+ * @return int  Number of events written, -1 on write error
+ */
+int exhevent_drain(void);
+
+/**
+ * @brief Drain the rings from a background thread.
+ *
+ * Only available with EXHANDLER_USE_PTHREAD.
+ *
+ * @param intervalms    Drain period in milliseconds.
+ * @return int          1 if the flusher runs, 0 otherwise
+ */
+int exhevent_start_flusher(int intervalms);
+
+/**
+ * @brief Stop recording, stop the flusher and drain remaining events.
+ */
+void exhevent_close(void);
+
+/**
+ * @brief Get the number of events dropped because a ring was full.
+ *
+ * @return size_t
+ */
+size_t exhevent_dropped(void);
+
+// ----------------------------------------------------------------------
+//                       CRASH FLIGHT RECORDER API
+// ----------------------------------------------------------------------
+
+#define EXH_FLIGHT_MAGIC        "EXHFLT1"
+#define EXH_FLIGHT_TRIES        4       /* innermost 'try' sites recorded */
+
+/*
+ * Flight recorder file layout, native byte order:
+ *
+ *      FlightHeader
+ *      { FlightThread, FlightRecord[nevents] }[nthreads]
+ *
+ * Each thread owns one slot and overwrites its records round robin. A
+ * record is complete when its seq is non zero, seq is stored last.
+ */
+typedef struct FlightHeader{
+    char magic[8];                  // EXH_FLIGHT_MAGIC
+    unsigned int nthreads;
+    unsigned int nevents;
+    unsigned int recordsize;        // sizeof(FlightRecord)
+    unsigned int used;              // slots claimed by threads
+    int pid;
+    unsigned int pad;
+    unsigned long long starttime;   // CLOCK_REALTIME, nanoseconds
+    char reserved[24];
+} FlightHeader;
+
+typedef struct FlightThread{
+    int thread;
+    unsigned int pad;
+    unsigned long long next;        // sequence number of the next record
+    char reserved[48];
+} FlightThread;
+
+typedef struct FlightTry{
+    int lineno;
+    char filename[28];
+} FlightTry;
+
+typedef struct FlightRecord{
+    unsigned long long seq;         // 0 while the record is incomplete
+    unsigned long long timestamp;   // CLOCK_REALTIME, nanoseconds
+    unsigned long long address;     // fault address of signal exceptions
+    int kind;                       // EXH_EVENT_*
+    int signum;
+    int lineno;
+    int depth;
+    char class[32];
+    char filename[48];
+    FlightTry tries[EXH_FLIGHT_TRIES];
+    char reserved[8];
+} FlightRecord;
+
+/**
+ * @brief Record the last throws and catches of every thread in a file.
+ *
+ * The file is mapped shared, records are written with plain stores so
+ * they reach the page cache even if the process dies right after. Use
+ * tools/exhflight.c to read the file back. Records are only written when
+ * the library is compiled with EXHANDLER_FLIGHT_RECORDER.
+ *
+ * @param filename  Path of the recorder file, created or truncated.
+ * @param nthreads  Number of threads that get a slot, later threads are
+ *                  not recorded.
+ * @param nevents   Number of records kept per thread.
+ * @return int      1 on success, 0 otherwise
+ */
+int exhflight_open(const char *filename, int nthreads, int nevents);
+
+/**
+ * @brief Stop recording and unmap the recorder file.
+ *
+ * No other thread may throw or catch while the file is closed.
+ */
+void exhflight_close(void);
+
+// ----------------------------------------------------------------------
+//                          THREAD DUMP API
+// ----------------------------------------------------------------------
+
+#ifndef EXH_DUMP_DEPTH
+#define EXH_DUMP_DEPTH          16  /* 'try' sites kept per thread */
+#endif
+
+typedef struct TrySite{
+    char *filename;
+    int lineno;
+} TrySite;
+
+typedef struct ThreadDump{
+    int thread;
+    int depth;                      // may exceed EXH_DUMP_DEPTH
+    TrySite tries[EXH_DUMP_DEPTH];  // outermost 'try' first
+    ObjectRef class;                // exception in flight, or NULL
+    State state;                    // PENDING_STATE or CAUGHT_STATE
+    char *filename;                 // where the exception was thrown
+    int lineno;
+} ThreadDump;
+
+/**
+ * @brief Take a snapshot of the 'try' chain of every thread.
+ *
+ * Each thread publishes its 'try' sites and exception in flight in a
+ * registry entry guarded by a sequence lock. Readers retry on concurrent
+ * updates and never block the threads they observe. Threads are only
+ * registered when the library is compiled with EXHANDLER_REGISTRY.
+ *
+ * @param dumps     Array receiving one entry per thread inside a 'try'.
+ * @param size      Number of entries in dumps.
+ * @return int      Number of threads inside a 'try', may exceed size
+ */
+int exhdump_snapshot(ThreadDump *dumps, int size);
+
+/**
+ * @brief Write the 'try' chain of every thread to a file descriptor.
+ *
+ * Async-signal-safe, one write(2) per thread.
+ *
+ * @param fd    File descriptor to write to.
+ */
+void exhdump_print(int fd);
+
+/**
+ * @brief Install a SIGQUIT handler writing exhdump_print() to stderr.
+ *
+ * @return int  1 on success, 0 otherwise
+ */
+int exhdump_install_sigquit(void);
+
+// ----------------------------------------------------------------------
+//                      CROSS-THREAD EXCEPTION API
+// ----------------------------------------------------------------------
+
+typedef struct ExceptionRecord{
+    volatile int refcount;
+    ObjectRef class;
+    void *data;                     // not copied, must outlive the record
+    char *filename;                 // where the exception was thrown
+    int lineno;
+    int thread;                     // thread that captured it
+    int depth;                      // may exceed EXH_DUMP_DEPTH
+    TrySite tries[EXH_DUMP_DEPTH];  // outermost 'try' first
+    int nframes;                    // EXHANDLER_BACKTRACE only
+    void *frames[EXH_BACKTRACE_DEPTH];
+    int ncauses;
+    ExceptionCause causes[EXH_CAUSE_DEPTH];
+} ExceptionRecord;
+
+/**
+ * @brief Capture the current exception into a self-contained record.
+ *
+ * Call it from a 'catch' or 'finally' block. The record holds the class,
+ * data, throw site, 'try' trace and call frames of the exception and can
+ * be handed to another thread, which rethrows it with exhrethrow().
+ *
+ * @param cptr  Pointer to thread exception context
+ * @return ExceptionRecord*  Record with one reference, NULL if there is
+ *                           no exception or on allocation failure
+ */
+ExceptionRecord* exhcapture(Context *cptr);
+
+/**
+ * @brief Add a reference to an exception record.
+ *
+ * @param record
+ * @return ExceptionRecord*  record
+ */
+ExceptionRecord* exhrecord_retain(ExceptionRecord *record);
+
+/**
+ * @brief Drop a reference, the record is freed with the last one.
+ *
+ * @param record
+ */
+void exhrecord_release(ExceptionRecord *record);
+
+/**
+ * @brief Throw a captured exception in the calling thread.
+ *
+ * The exception keeps its class, data and original throw site. The
+ * caller keeps its reference to the record, release it once the
+ * exception is handled, for instance in 'finally'.
+ *
+ * @param cptr      Pointer to thread exception context
+ * @param record    Record returned by exhcapture(), ignored when NULL.
+ */
+void exhrethrow(Context *cptr, ExceptionRecord *record);
+
+/**
+ * @brief Dispatch exception 'throw' caused by another exception
+ *
+ * @param cptr
+ * @param except
+ * @param data
+ * @param cause     Exception, usually caught, or NULL.
+ * @param filename
+ * @param lineno
+ */
+void exhthrow_cause(
+    Context *cptr, void *except, void *data, ExceptionType *cause,
+    char *filename, int lineno
+);
+
+/**
+ * @brief Throw the caught exception of the innermost 'try' again.
+ *
+ * Nothing is copied: the exception becomes pending again in its frame and
+ * propagates from there. The catch that ends it is not counted again by
+ * EXHANDLER_STATS. Without a caught exception nothing is thrown, it is
+ * reported on stderr like a lost exception.
+ *
+ * @param cptr
+ * @param filename  Source file of the exh_rethrow().
+ * @param lineno    Line of the exh_rethrow().
+ */
+void exhrethrow_caught(Context *cptr, char *filename, int lineno);
+
+// ----------------------------------------------------------------------
+//                            TASK POOL API
+// ----------------------------------------------------------------------
+
+typedef struct TaskPool TaskPool;
+typedef struct Future Future;
+typedef void* (*exh_taskFn)(void *arg);
+typedef void (*exh_loopFn)(int index, void *arg);
+
+/* data of an AggregateError, every exception of a parallel loop */
+typedef struct AggregateData{
+    int count;
+    ExceptionRecord **records;
+} AggregateData;
+
+#define exh_future_get(future)  exhfuture_get(cptr, future)
+#define exh_parallel_for(pool, begin, end, fn, arg)    \
+    exhpool_parallel_for(cptr, pool, begin, end, fn, arg, __FILE__, __LINE__)
+
+/**
+ * @brief Create a work-stealing pool of worker threads.
+ *
+ * Each worker has its own task deque and steals from the others when it
+ * runs dry. Workers run their tasks inside a 'try' that lives as long as
+ * the thread, so tasks never create or look up a Context. Only available
+ * with EXHANDLER_USE_PTHREAD.
+ *
+ * @param nworkers  Number of workers, the number of CPUs when <= 0.
+ * @return TaskPool*  NULL on failure
+ */
+TaskPool* exhpool_new(int nworkers);
+
+/**
+ * @brief Run the queued tasks, stop the workers and free the pool.
+ *
+ * @param pool
+ */
+void exhpool_delete(TaskPool *pool);
+
+/**
+ * @brief Queue a task.
+ *
+ * Tasks submitted from a worker go to its own deque, others are spread
+ * round robin.
+ *
+ * @param pool
+ * @param fn    Task function, its return value is the future's result.
+ * @param arg   Argument given to fn.
+ * @return Future*  NULL on allocation failure
+ */
+Future* exhpool_submit(TaskPool *pool, exh_taskFn fn, void *arg);
+
+/**
+ * @brief Wait for a task and get its result.
+ *
+ * If the task threw, the exception is rethrown in the calling thread
+ * with its original class, data and site. A worker waiting on a future
+ * runs other tasks meanwhile.
+ *
+ * @param cptr      Pointer to thread exception context
+ * @param future
+ * @return void*    Value returned by the task
+ */
+void* exhfuture_get(Context *cptr, Future *future);
+
+/**
+ * @brief Free a future, waiting for its task if needed.
+ *
+ * @param future
+ */
+void exhfuture_delete(Future *future);
+
+/**
+ * @brief Call fn(index, arg) for each index in [begin, end) on the pool.
+ *
+ * Every exception thrown by fn is captured. When the loop is done and
+ * some calls threw, an AggregateError is thrown with an AggregateData
+ * holding all of them, free it with exhaggregate_delete().
+ *
+ * @param cptr      Pointer to thread exception context
+ * @param pool
+ * @param begin     First index.
+ * @param end       One past the last index.
+ * @param fn        Loop body.
+ * @param arg       Argument given to fn.
+ * @param filename  Source file name where the loop runs.
+ * @param lineno    Source file line number.
+ */
+void exhpool_parallel_for(
+    Context *cptr, TaskPool *pool, int begin, int end, exh_loopFn fn,
+    void *arg, char *filename, int lineno);
+
+/**
+ * @brief Release the records of an AggregateError and free its data.
+ *
+ * @param data
+ */
+void exhaggregate_delete(AggregateData *data);
+
+// ----------------------------------------------------------------------
+//                           CANCELLATION API
+// ----------------------------------------------------------------------
+
+#ifndef EXH_CANCEL_SIGNAL
+#define EXH_CANCEL_SIGNAL       (SIGRTMIN + 1)
+#endif
+
+/**
+ * @brief Ask another thread to throw an exception in its innermost 'try'.
+ *
+ * The exception is left pending in the target's Context. The target
+ * throws it at its next exh_cancel_point(). With async, the target is
+ * also sent EXH_CANCEL_SIGNAL and throws it from the signal handler,
+ * like a trap, but only from the body of a 'try' and outside library
+ * code; otherwise it is left for the next exh_cancel_point(). Only use
+ * async on code that may be interrupted anywhere, such as a computation
+ * that holds no locks and does not allocate other than with exh_mem_*.
+ *
+ * @param thread    Target thread id: (int)pthread_self() of the target
+ *                  with EXHANDLER_USE_PTHREAD, what the application's
+ *                  EXHANDLER_THREAD_ID_FUNC() returns in other threaded
+ *                  builds, ignored in single-threaded ones.
+ * @param cls       Exception class to throw.
+ * @param async     Also interrupt the target with EXH_CANCEL_SIGNAL,
+ *                  EXHANDLER_USE_PTHREAD only.
+ * @return int      1 if the target is inside a 'try', 0 otherwise
+ */
+int exhcancel(int thread, ObjectRef cls, int async);
+
+/**
+ * @brief Throw the exception left by exhcancel(), if any.
+ *
+ * Used by exh_cancel_point().
+ *
+ * @param cptr      Pointer to thread exception context
+ * @param filename  Source file name of the cancellation point.
+ * @param lineno    Source file line number.
+ */
+void exhcancel_throw(Context *cptr, char *filename, int lineno);
+
+// ----------------------------------------------------------------------
+//                             DEADLINE API
+// ----------------------------------------------------------------------
+
+#ifndef EXH_TIMEOUT_SIGNAL
+#define EXH_TIMEOUT_SIGNAL      (SIGRTMIN + 2)
+#endif
+
+/**
+ * @brief Bound the innermost 'try' to a deadline, used by try_deadline().
+ *
+ * When the deadline expires TimeoutError is thrown into the innermost
+ * 'try', through the same signal path as traps, once the thread is back
+ * in the body of a 'try' and out of library code. A nested deadline never
+ * extends the enclosing one. Each thread owns one POSIX timer delivering
+ * EXH_TIMEOUT_SIGNAL to itself, arming costs a clock read and one
+ * timer_settime(). Deadlines are only enforced when the library is
+ * compiled with EXHANDLER_DEADLINE.
+ *
+ * Every deadline is asynchronous, like exhcancel() with async: the body
+ * is cut short wherever it is. TimeoutError is only safe around code that
+ * holds no locks and allocates with exh_mem_* alone, or makes no libc call
+ * at all; a body cut short inside malloc() corrupts the heap.
+ *
+ * @param cptr  Pointer to thread exception context
+ * @param ns    Time allowed from now, in nanoseconds.
+ */
+void exhdeadline(Context *cptr, long long ns);
+
+// ----------------------------------------------------------------------
+//                          CLASS REGISTRY API
+// ----------------------------------------------------------------------
+
+/*
+ * Registered classes are identified by their interned name: two class
+ * objects registered under the same name and parent are the same class to
+ * 'catch'. A plugin loaded with dlopen() can so throw and catch the
+ * classes of its host without sharing its symbols. Ids are dense, from 1
+ * in registration order; the classes of exhandler.h are registered first.
+ */
+
+/**
+ * @brief Register a class defined with EXH_DEFINE, and its ancestors.
+ *
+ * @param class Class to register.
+ * @return int  Id of the class, 0 when a class of the same name but
+ *              another parent is registered or memory is exhausted.
+ */
+int exhclass_register(ObjectRef class);
+
+/**
+ * @brief Define a class at run time, or get the registered one.
+ *
+ * @param name      Class name, copied.
+ * @param parent    Parent class, Exception if NULL.
+ * @return ObjectRef The class, NULL when a class of the same name but
+ *                  another parent is registered or memory is exhausted.
+ */
+ObjectRef exhclass_define(const char *name, ObjectRef parent);
+
+/**
+ * @brief Find a registered class by name, in constant time.
+ *
+ * @param name      Class name.
+ * @return ObjectRef The class, NULL if none is registered under name.
+ */
+ObjectRef exhclass_find(const char *name);
+
+/**
+ * @brief Get a registered class by id, in constant time.
+ *
+ * @param id        Id returned by exhclass_register().
+ * @return ObjectRef The class, NULL if the id is unknown.
+ */
+ObjectRef exhclass_get(int id);
+
 #endif /* __EXHANDLER_H_ */
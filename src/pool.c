@@ -0,0 +1,492 @@
+#include<string.h>
+#include "exhandler.h"
+
+#ifdef EXHANDLER_USE_PTHREAD
+#include<pthread.h>
+#include<time.h>
+#include<unistd.h>
+
+#define EXH_QUEUE_DEFAULT_SIZE      64      /* power of 2 */
+#define EXH_CHUNKS_PER_WORKER       4
+#define EXH_HELP_WAIT_NS            1000000
+
+typedef struct Task{
+    exh_taskFn fn;
+    void *arg;
+    Future *future;
+} Task;
+
+typedef struct WorkQueue{
+    pthread_mutex_t lock;
+    Task *tasks;
+    unsigned head;                  // steal end
+    unsigned tail;                  // owner end
+    unsigned size;
+} WorkQueue;
+
+typedef struct Worker{
+    TaskPool *pool;
+    pthread_t thread;
+    WorkQueue queue;
+    int index;
+} Worker;
+
+struct TaskPool{
+    int nworkers;
+    Worker *workers;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    volatile int queued;
+    volatile int stop;
+    volatile unsigned next;
+};
+
+struct Future{
+    TaskPool *pool;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    volatile int done;
+    void *result;
+    ExceptionRecord *error;
+};
+
+typedef struct Loop{
+    exh_loopFn fn;
+    void *arg;
+    pthread_mutex_t lock;
+    int count;
+    int size;
+    ExceptionRecord **records;
+} Loop;
+
+typedef struct Chunk{
+    Loop *loop;
+    int begin;
+    int end;
+} Chunk;
+
+static __thread Worker *currentWorker;
+
+/********************************************************************/
+/*                   Work Queue Implementation                      */
+/********************************************************************/
+// -----------------------------------------------------------------
+// queue_push() :: push a task at the owner end, growing the deque
+// -----------------------------------------------------------------
+static int queue_push(WorkQueue *queue, Task *task){
+    // no asynchronous exception while a lock is held
+    EXH_BUSY_BEGIN(exhcurrent_context);
+    pthread_mutex_lock(&queue->lock);
+    if(queue->tail - queue->head == queue->size){
+        Task *tasks = malloc(2 * queue->size * sizeof(Task));
+        if(tasks == NULL){
+            pthread_mutex_unlock(&queue->lock);
+            EXH_BUSY_END(exhcurrent_context);
+            return 0;
+        }
+        for(unsigned i=0; i < queue->size; i++){
+            tasks[i] = queue->tasks[(queue->head + i) & (queue->size - 1)];
+        }
+        free(queue->tasks);
+        queue->tasks = tasks;
+        queue->head = 0;
+        queue->tail = queue->size;
+        queue->size *= 2;
+    }
+    queue->tasks[queue->tail++ & (queue->size - 1)] = *task;
+    pthread_mutex_unlock(&queue->lock);
+    EXH_BUSY_END(exhcurrent_context);
+
+    return 1;
+}
+
+// -----------------------------------------------------------------
+// queue_pop() :: take the newest task, owner side
+// -----------------------------------------------------------------
+static int queue_pop(WorkQueue *queue, Task *task){
+    int found = 0;
+    EXH_BUSY_BEGIN(exhcurrent_context);
+    pthread_mutex_lock(&queue->lock);
+    if(queue->tail != queue->head){
+        *task = queue->tasks[--queue->tail & (queue->size - 1)];
+        found = 1;
+    }
+    pthread_mutex_unlock(&queue->lock);
+    EXH_BUSY_END(exhcurrent_context);
+
+    return found;
+}
+
+// -----------------------------------------------------------------
+// queue_steal() :: take the oldest task, thief side
+// -----------------------------------------------------------------
+static int queue_steal(WorkQueue *queue, Task *task){
+    int found = 0;
+    // an empty deque is skipped without taking its lock
+    if(__atomic_load_n(&queue->tail, __ATOMIC_RELAXED) ==
+        __atomic_load_n(&queue->head, __ATOMIC_RELAXED)){
+        return 0;
+    }
+    EXH_BUSY_BEGIN(exhcurrent_context);
+    pthread_mutex_lock(&queue->lock);
+    if(queue->tail != queue->head){
+        *task = queue->tasks[queue->head++ & (queue->size - 1)];
+        found = 1;
+    }
+    pthread_mutex_unlock(&queue->lock);
+    EXH_BUSY_END(exhcurrent_context);
+
+    return found;
+}
+
+/********************************************************************/
+/*                    Task Pool Implementation                      */
+/********************************************************************/
+// -----------------------------------------------------------------
+// exhpool_take() :: own task first, then steal from the other workers
+// -----------------------------------------------------------------
+static int exhpool_take(TaskPool *pool, Worker *self, Task *task){
+    int start = self ? self->index + 1 : 0;
+    int found = self && queue_pop(&self->queue, task);
+
+    for(int i=0; !found && i < pool->nworkers; i++){
+        Worker *victim = &pool->workers[(start + i) % pool->nworkers];
+        if(victim != self){ found = queue_steal(&victim->queue, task); }
+    }
+    if(found){ __atomic_sub_fetch(&pool->queued, 1, __ATOMIC_RELAXED); }
+
+    return found;
+}
+
+// -----------------------------------------------------------------
+// exhpool_run() :: run a task, capture what it throws, complete it
+// -----------------------------------------------------------------
+static void exhpool_run(Task *task){
+    void *volatile result = NULL;
+    ExceptionRecord *volatile error = NULL;
+    Future *future = task->future;
+
+    try{
+        result = task->fn(task->arg);
+    }catch(Throwable, e){
+        error = exhcapture(cptr);
+    }finally{}
+
+    EXH_BUSY_BEGIN(exhcurrent_context);
+    pthread_mutex_lock(&future->lock);
+    future->result = result;
+    future->error = error;
+    __atomic_store_n(&future->done, 1, __ATOMIC_RELEASE);
+    pthread_cond_broadcast(&future->cond);
+    pthread_mutex_unlock(&future->lock);
+    EXH_BUSY_END(exhcurrent_context);
+}
+
+// -----------------------------------------------------------------
+// exhpool_worker() :: worker thread main loop
+// -----------------------------------------------------------------
+static void* exhpool_worker(void *arg){
+    Worker *self = arg;
+    TaskPool *pool = self->pool;
+
+    currentWorker = self;
+    // the outermost 'try' keeps this thread's Context alive between tasks
+    try{
+        while(1){
+            Task task;
+            int stop;
+            if(exhpool_take(pool, self, &task)){
+                exhpool_run(&task);
+                continue;
+            }
+            EXH_BUSY_BEGIN(exhcurrent_context);
+            pthread_mutex_lock(&pool->lock);
+            while(!pool->queued && !pool->stop){
+                pthread_cond_wait(&pool->wake, &pool->lock);
+            }
+            stop = pool->stop && !pool->queued;
+            pthread_mutex_unlock(&pool->lock);
+            EXH_BUSY_END(exhcurrent_context);
+            if(stop){ break; }
+        }
+    }finally{}
+
+    return NULL;
+}
+
+// -----------------------------------------------------------------
+// exhpool_wait() :: wait for a future, workers run other tasks meanwhile
+// -----------------------------------------------------------------
+static void exhpool_wait(Future *future){
+    Worker *self = currentWorker;
+    Task task;
+
+    if(self != NULL && self->pool != future->pool){ self = NULL; }
+    while(!__atomic_load_n(&future->done, __ATOMIC_ACQUIRE)){
+        if(self != NULL && exhpool_take(future->pool, self, &task)){
+            exhpool_run(&task);
+            continue;
+        }
+        EXH_BUSY_BEGIN(exhcurrent_context);
+        pthread_mutex_lock(&future->lock);
+        if(!future->done && self == NULL){
+            pthread_cond_wait(&future->cond, &future->lock);
+        }else if(!future->done){
+            // a worker wakes up now and then to help with new tasks
+            struct timespec deadline;
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            deadline.tv_nsec += EXH_HELP_WAIT_NS;
+            if(deadline.tv_nsec >= 1000000000L){
+                deadline.tv_sec++;
+                deadline.tv_nsec -= 1000000000L;
+            }
+            pthread_cond_timedwait(&future->cond, &future->lock, &deadline);
+        }
+        pthread_mutex_unlock(&future->lock);
+        EXH_BUSY_END(exhcurrent_context);
+    }
+}
+
+// -----------------------------------------------------------------
+// exhpool_index() :: run one loop index, keep what it throws
+// -----------------------------------------------------------------
+static void exhpool_index(Loop *loop, int index){
+    try{
+        loop->fn(index, loop->arg);
+    }catch(Throwable, e){
+        ExceptionRecord *record = exhcapture(cptr);
+        pthread_mutex_lock(&loop->lock);
+        if(record != NULL && loop->count == loop->size){
+            int size = loop->size ? 2 * loop->size : 8;
+            ExceptionRecord **records;
+            records = realloc(loop->records, size * sizeof(ExceptionRecord*));
+            if(records != NULL){
+                loop->records = records;
+                loop->size = size;
+            }
+        }
+        if(record != NULL && loop->count < loop->size){
+            loop->records[loop->count++] = record;
+        }else{
+            exhrecord_release(record);
+        }
+        pthread_mutex_unlock(&loop->lock);
+    }finally{}
+}
+
+// -----------------------------------------------------------------
+// exhpool_chunk() :: task running a range of loop indices
+// -----------------------------------------------------------------
+static void* exhpool_chunk(void *arg){
+    Chunk *chunk = arg;
+    for(int i=chunk->begin; i < chunk->end; i++){
+        exhpool_index(chunk->loop, i);
+    }
+    return NULL;
+}
+#endif /* EXHANDLER_USE_PTHREAD */
+
+// -- 99
+TaskPool* exhpool_new(int nworkers){
+#ifdef EXHANDLER_USE_PTHREAD
+    TaskPool *pool;
+    int started = 0;
+
+    if(nworkers <= 0){ nworkers = sysconf(_SC_NPROCESSORS_ONLN); }
+    if(nworkers <= 0){ nworkers = 1; }
+    if((pool = calloc(1, sizeof(TaskPool))) == NULL){ return NULL; }
+    if((pool->workers = calloc(nworkers, sizeof(Worker))) == NULL){
+        free(pool);
+        return NULL;
+    }
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->wake, NULL);
+    for(int i=0; i < nworkers; i++){
+        Worker *worker = &pool->workers[i];
+        worker->pool = pool;
+        worker->index = i;
+        worker->queue.size = EXH_QUEUE_DEFAULT_SIZE;
+        worker->queue.tasks = malloc(EXH_QUEUE_DEFAULT_SIZE * sizeof(Task));
+        if(worker->queue.tasks == NULL){ break; }
+        pthread_mutex_init(&worker->queue.lock, NULL);
+        pool->nworkers = i + 1;
+    }
+    for(; started < pool->nworkers; started++){
+        Worker *worker = &pool->workers[started];
+        if(pthread_create(&worker->thread, NULL, exhpool_worker, worker)){
+            break;
+        }
+    }
+    if(started < nworkers){
+        pool->nworkers = started;
+        exhpool_delete(pool);
+        return NULL;
+    }
+
+    return pool;
+#else
+    return NULL;
+#endif
+}
+
+// -- 100
+void exhpool_delete(TaskPool *pool){
+#ifdef EXHANDLER_USE_PTHREAD
+    if(pool == NULL){ return; }
+    EXH_BUSY_BEGIN(exhcurrent_context);
+    pthread_mutex_lock(&pool->lock);
+    pool->stop = 1;
+    pthread_cond_broadcast(&pool->wake);
+    pthread_mutex_unlock(&pool->lock);
+    EXH_BUSY_END(exhcurrent_context);
+    for(int i=0; i < pool->nworkers; i++){
+        pthread_join(pool->workers[i].thread, NULL);
+    }
+    for(int i=0; i < pool->nworkers; i++){
+        pthread_mutex_destroy(&pool->workers[i].queue.lock);
+        free(pool->workers[i].queue.tasks);
+    }
+    pthread_cond_destroy(&pool->wake);
+    pthread_mutex_destroy(&pool->lock);
+    free(pool->workers);
+    free(pool);
+#endif
+}
+
+// -- 101
+Future* exhpool_submit(TaskPool *pool, exh_taskFn fn, void *arg){
+#ifdef EXHANDLER_USE_PTHREAD
+    Worker *worker = currentWorker;
+    Future *future;
+    Task task;
+
+    if(pool == NULL){ return NULL; }
+    EXH_BUSY_BEGIN(exhcurrent_context);
+    if((future = calloc(1, sizeof(Future))) == NULL){
+        EXH_BUSY_END(exhcurrent_context);
+        return NULL;
+    }
+    future->pool = pool;
+    pthread_mutex_init(&future->lock, NULL);
+    pthread_cond_init(&future->cond, NULL);
+    task.fn = fn;
+    task.arg = arg;
+    task.future = future;
+    if(worker == NULL || worker->pool != pool){
+        unsigned next = __atomic_fetch_add(&pool->next, 1, __ATOMIC_RELAXED);
+        worker = &pool->workers[next % pool->nworkers];
+    }
+    if(!queue_push(&worker->queue, &task)){
+        pthread_cond_destroy(&future->cond);
+        pthread_mutex_destroy(&future->lock);
+        free(future);
+        EXH_BUSY_END(exhcurrent_context);
+        return NULL;
+    }
+    __atomic_add_fetch(&pool->queued, 1, __ATOMIC_RELAXED);
+    pthread_mutex_lock(&pool->lock);
+    pthread_cond_signal(&pool->wake);
+    pthread_mutex_unlock(&pool->lock);
+    EXH_BUSY_END(exhcurrent_context);
+
+    return future;
+#else
+    return NULL;
+#endif
+}
+
+// -- 102
+void* exhfuture_get(Context *cptr, Future *future){
+#ifdef EXHANDLER_USE_PTHREAD
+    exhpool_wait(future);
+    if(future->error != NULL){
+        exhrethrow(cptr, future->error);
+    }
+    return future->result;
+#else
+    return NULL;
+#endif
+}
+
+// -- 103
+void exhfuture_delete(Future *future){
+#ifdef EXHANDLER_USE_PTHREAD
+    if(future == NULL){ return; }
+    exhpool_wait(future);
+    EXH_BUSY_BEGIN(exhcurrent_context);
+    exhrecord_release(future->error);
+    pthread_cond_destroy(&future->cond);
+    pthread_mutex_destroy(&future->lock);
+    free(future);
+    EXH_BUSY_END(exhcurrent_context);
+#endif
+}
+
+// -- 104
+void exhpool_parallel_for(
+    Context *cptr, TaskPool *pool, int begin, int end, exh_loopFn fn,
+    void *arg, char *filename, int lineno
+){
+#ifdef EXHANDLER_USE_PTHREAD
+    Loop loop;
+    Chunk *chunks;
+    Future **futures;
+    AggregateData *data;
+    int nchunks, step;
+
+    if(pool == NULL || end <= begin){ return; }
+    nchunks = pool->nworkers * EXH_CHUNKS_PER_WORKER;
+    if(nchunks > end - begin){ nchunks = end - begin; }
+    step = (end - begin + nchunks - 1) / nchunks;
+    nchunks = (end - begin + step - 1) / step;
+    chunks = malloc(nchunks * sizeof(Chunk));
+    futures = calloc(nchunks, sizeof(Future*));
+    if(chunks == NULL || futures == NULL){
+        free(chunks);
+        free(futures);
+        exhthrow(cptr, OutOfMemoryError, NULL, filename, lineno);
+        return;
+    }
+    memset(&loop, 0, sizeof(loop));
+    loop.fn = fn;
+    loop.arg = arg;
+    pthread_mutex_init(&loop.lock, NULL);
+    for(int i=0; i < nchunks; i++){
+        chunks[i].loop = &loop;
+        chunks[i].begin = begin + i * step;
+        chunks[i].end = chunks[i].begin + step < end ?
+            chunks[i].begin + step : end;
+        futures[i] = exhpool_submit(pool, exhpool_chunk, &chunks[i]);
+        if(futures[i] == NULL){ exhpool_chunk(&chunks[i]); }
+    }
+    for(int i=0; i < nchunks; i++){
+        exhfuture_delete(futures[i]);
+    }
+    pthread_mutex_destroy(&loop.lock);
+    free(futures);
+    free(chunks);
+    if(loop.count == 0){ return; }
+
+    if((data = malloc(sizeof(AggregateData))) == NULL){
+        for(int i=0; i < loop.count; i++){
+            exhrecord_release(loop.records[i]);
+        }
+        free(loop.records);
+        exhthrow(cptr, OutOfMemoryError, NULL, filename, lineno);
+        return;
+    }
+    data->count = loop.count;
+    data->records = loop.records;
+    exhthrow(cptr, AggregateError, data, filename, lineno);
+#endif
+}
+
+// -- 105
+void exhaggregate_delete(AggregateData *data){
+    if(data == NULL){ return; }
+    for(int i=0; i < data->count; i++){
+        exhrecord_release(data->records[i]);
+    }
+    free(data->records);
+    free(data);
+}
@@ -31,7 +31,7 @@ void stack_delete(Stack *stack){
 void stack_delete_with_data(Stack *stack){
     assert(stack != NULL);
     while(stack->len > 0){
-        free(stack->data[stack->len--]);
+        free(stack->data[--stack->len]);
     }
     free(stack->data);
     stack->data = NULL;
@@ -92,7 +92,7 @@ void list_delete(List *list){
     ListNode *cursor;
     cursor = list->head->next;
     while(cursor != list->head){
-        List *node;
+        ListNode *node;
         node = cursor->next;
         free(cursor);
         cursor = node;
@@ -127,10 +127,10 @@ void list_prepend(List *list, void *data){
     ListNode *node;
     node = malloc(sizeof(ListNode));
     node->data = data;
-    node->next->prev = node;
-    list->head->next->prev = node;
-    list->head->next->prev = list->head;
+    node->next = list->head->next;
     node->prev = list->head;
+    list->head->next->prev = node;
+    list->head->next = node;
     list->pointer = node;
     list->len++;
 }
@@ -142,10 +142,10 @@ void list_append(List *list, void *data){
     node = malloc(sizeof(*node));
 
     node->data = data;
-    node->prev->next = node;
-    list->head->prev->prev = node;
-    list->head->prev->next = list->head;
+    node->prev = list->head->prev;
     node->next = list->head;
+    list->head->prev->next = node;
+    list->head->prev = node;
     list->pointer = node;
     list->len++;
 }
@@ -157,10 +157,10 @@ void list_insert_before(List *list, void *data){
     ListNode *node;
     node = malloc(sizeof(*node));
     node->data = data;
-    node->prev->next = node;
-    list->pointer->prev->next = node;
-    list->pointer->next = list->pointer;
+    node->prev = list->pointer->prev;
     node->next = list->pointer;
+    list->pointer->prev->next = node;
+    list->pointer->prev = node;
     list->pointer = node;
     list->len++;
 }
@@ -172,16 +172,16 @@ void list_insert_after(List *list, void *data){
     ListNode *node;
     node = malloc(sizeof(*node));
     node->data = data;
-    node->next->prev = node;
-    list->pointer->next->prev = node;
-    list->pointer->next->prev = list->pointer;
+    node->next = list->pointer->next;
     node->prev = list->pointer;
+    list->pointer->next->prev = node;
+    list->pointer->next = node;
     list->pointer = node;
     list->len++;
 }
 
 // -- 15
-void list_remove_head(List *list){
+void* list_remove_head(List *list){
     assert(list != NULL);
     exh_validate(list->len > 0, NULL);
     ListNode *node;
@@ -189,7 +189,8 @@ void list_remove_head(List *list){
 
     node = list->head->next;
     data = node->data;
-    list->head->next->prev = list->head;
+    list->head->next = node->next;
+    node->next->prev = list->head;
     free(node);
     list->pointer = NULL;
     list->len--;
@@ -206,7 +207,7 @@ void* list_remove_tail(List *list){
 
     node = list->head->prev;
     data = node->data;
-    list->head->prev->next = list->head;
+    list->head->prev = node->prev;
     node->prev->next = list->head;
     free(node);
     list->pointer = NULL;
@@ -216,13 +217,13 @@ void* list_remove_tail(List *list){
 }
 
 // -- 17
-void list_remove(List *list, void *data){
+void* list_remove(List *list, void *data){
     assert(list != NULL);
     exh_validate(list->len > 0, NULL);
     ListNode *node;
 
     node = list->head->next;
-    while(node->data != list->head && node->data != data){
+    while(node != list->head && node->data != data){
         node = node->next;
     }
     exh_validate(node->data == data, NULL);
@@ -236,7 +237,7 @@ void list_remove(List *list, void *data){
 }
 
 // -- 18
-void list_remove_last(List *list){
+void* list_remove_last(List *list){
     assert(list != NULL);
     exh_validate(list->pointer != NULL, NULL);
     ListNode *node;
@@ -398,7 +399,7 @@ List* list_split_after(List *list){
     }
 
     retlist->pointer = NULL;
-    retlist retlist;
+    return retlist;
 }
 
 // -- 28
@@ -0,0 +1,455 @@
+#include<stdio.h>
+#include<stdlib.h>
+#include<string.h>
+#include<fcntl.h>
+#include<unistd.h>
+#ifdef EXHANDLER_USE_PTHREAD
+#include<pthread.h>
+#include<sched.h>
+#endif
+#include "../src/exhandler.h"
+
+/*
+ * exhtest :: behaviour of the exception runtime, one run per variant
+ *
+ *      exhtest [events flight]
+ *
+ * Each check prints a line when it fails; the exit status is the number
+ * of failed checks. Built once against the release library of a variant
+ * and once against its DEBUG one, where the catch clause checks of the
+ * library run too. The checks of an optional switch only run when the
+ * variant has it. With EXHANDLER_EVENTS and EXHANDLER_FLIGHT_RECORDER the
+ * run is recorded in the files 'events' and 'flight', for exhdecode and
+ * exhflight to read back.
+ */
+
+EXH_DECLARE(IoError, Exception);
+EXH_DECLARE(ParseError, Exception);
+EXH_DECLARE(SyntaxError, ParseError);
+EXH_DEFINE(IoError, Exception);
+EXH_DEFINE(ParseError, Exception);
+EXH_DEFINE(SyntaxError, ParseError);
+
+static int failures;
+
+#define CHECK(expr) do{                                                 \
+        if(!(expr)){                                                    \
+            fprintf(stderr, "%s:%d: check failed: %s\n",                \
+                __FILE__, __LINE__, #expr);                             \
+            failures++;                                                 \
+        }                                                               \
+    }while(0)
+
+// -----------------------------------------------------------------
+// throw_io() :: throw IoError one call below the 'try'
+// -----------------------------------------------------------------
+static void throw_io(char *data){
+    throw(IoError, data);
+}
+
+// -----------------------------------------------------------------
+// is_fatal() :: catch_if predicate, the data is a "fatal" string
+// -----------------------------------------------------------------
+static int is_fatal(void *data){
+    return data != NULL && strcmp(data, "fatal") == 0;
+}
+
+// -----------------------------------------------------------------
+// test_throw() :: throw, catch by base class, finally always runs
+// -----------------------------------------------------------------
+static void test_throw(void){
+    volatile int caught = 0, finals = 0, after = 0;
+
+    try{
+        throw_io("io");
+        after = 1;
+    }catch(Exception, e){
+        caught = 1;
+        CHECK(e->class == IoError);
+        CHECK(strcmp(e->data, "io") == 0);
+    }finally{
+        finals++;
+    }
+    CHECK(caught && !after && finals == 1);
+
+    caught = 0;
+    try{
+        after = 1;
+    }catch(Exception, e){
+        caught = 1;
+    }finally{
+        finals++;
+    }
+    CHECK(!caught && after && finals == 2);
+}
+
+// -----------------------------------------------------------------
+// test_nested() :: an uncaught exception goes to the enclosing 'try',
+// after the finally of the inner one
+// -----------------------------------------------------------------
+static void test_nested(void){
+    volatile int inner = 0, outer = 0, order = 0;
+
+    try{
+        try{
+            throw(SyntaxError, NULL);
+        }catch(IoError, e){
+            inner = 1;
+        }finally{
+            order = 1;
+        }
+    }catch(ParseError, e){
+        outer = order == 1 ? 2 : 1;
+        CHECK(e->class == SyntaxError);
+    }finally{}
+    CHECK(!inner && outer == 2);
+}
+
+// -----------------------------------------------------------------
+// test_nosig() :: try_nosig behaves as 'try' for thrown exceptions
+// -----------------------------------------------------------------
+static void test_nosig(void){
+    volatile int caught = 0, finals = 0;
+
+    try_nosig{
+        try_nosig{
+            throw(IoError, NULL);
+        }catch(ParseError, e){
+            caught = -1;
+        }finally{
+            finals++;
+        }
+    }catch(IoError, e){
+        caught = 1;
+    }finally{
+        finals++;
+    }
+    CHECK(caught == 1 && finals == 2);
+}
+
+// -----------------------------------------------------------------
+// test_catch_any() :: any of the listed classes, walking the hierarchy
+// -----------------------------------------------------------------
+static void test_catch_any(void){
+    volatile int caught = 0;
+
+    try{
+        throw(SyntaxError, NULL);
+    }catch_any(e, IoError, ParseError){
+        caught = 1;
+        CHECK(e->class == SyntaxError);
+    }catch(Exception, e){
+        caught = 2;
+    }finally{}
+    CHECK(caught == 1);
+
+    caught = 0;
+    try{
+        throw(OutOfMemoryError, NULL);
+    }catch_any(e, IoError, ParseError){
+        caught = 1;
+    }catch(Exception, e){
+        caught = 2;
+    }finally{}
+    CHECK(caught == 2);
+}
+
+// -----------------------------------------------------------------
+// test_catch_if() :: the predicate decides, else the next clauses
+// -----------------------------------------------------------------
+static void test_catch_if(void){
+    volatile int caught = 0;
+
+    try{
+        throw_io("fatal");
+    }catch_if(IoError, e, is_fatal){
+        caught = 1;
+    }catch(IoError, e){
+        caught = 2;
+    }finally{}
+    CHECK(caught == 1);
+
+    caught = 0;
+    try{
+        throw_io("retry");
+    }catch_if(IoError, e, is_fatal){
+        caught = 1;
+    }catch(IoError, e){
+        caught = 2;
+    }finally{}
+    CHECK(caught == 2);
+}
+
+// -----------------------------------------------------------------
+// test_rethrow() :: exh_rethrow() keeps the throw site, rethrow()
+// of a captured record throws it again later
+// -----------------------------------------------------------------
+static void test_rethrow(void){
+    ExceptionRecord *volatile record = NULL;
+    volatile int lineno = 0, caught = 0, finals = 0;
+
+    try{
+        try{
+            throw_io("again");
+        }catch(IoError, e){
+            lineno = e->lineno;
+            exh_rethrow();
+        }finally{
+            finals++;
+        }
+    }catch(IoError, e){
+        caught = 1;
+        CHECK(e->lineno == lineno);
+        CHECK(strcmp(e->data, "again") == 0);
+    }finally{
+        finals++;
+    }
+    CHECK(caught && finals == 2);
+
+    try{
+        throw(ParseError, NULL);
+    }catch(ParseError, e){
+        record = exhcapture(cptr);
+    }finally{}
+    CHECK(record != NULL);
+
+    caught = 0;
+    try{
+        rethrow(record);
+    }catch(ParseError, e){
+        caught = 1;
+    }finally{}
+    CHECK(caught);
+    exhrecord_release(record);
+}
+
+#ifdef EXHANDLER_USE_PTHREAD
+// -----------------------------------------------------------------
+// task_echo() :: pool task returning its argument
+// -----------------------------------------------------------------
+static void* task_echo(void *arg){
+    return arg;
+}
+
+// -----------------------------------------------------------------
+// task_throw() :: pool task throwing IoError with its argument
+// -----------------------------------------------------------------
+static void* task_throw(void *arg){
+    throw(IoError, arg);
+    return NULL;
+}
+
+// -----------------------------------------------------------------
+// loop_throw() :: parallel loop body, every fourth index throws
+// -----------------------------------------------------------------
+static void loop_throw(int index, void *arg){
+    __atomic_fetch_add((int*)arg, 1, __ATOMIC_RELAXED);
+    if(index % 4 == 0){
+        throw(ParseError, NULL);
+    }
+}
+
+// -----------------------------------------------------------------
+// test_pool() :: a future rethrows the exception of its task, a
+// parallel loop throws all of its exceptions as one AggregateError
+// -----------------------------------------------------------------
+static void test_pool(void){
+    TaskPool *pool = exhpool_new(2);
+    Future *echo, *failed;
+    volatile int caught = 0, count = 0, parsed = 0;
+    int calls = 0;
+
+    CHECK(pool != NULL);
+    if(pool == NULL){ return; }
+    echo = exhpool_submit(pool, task_echo, "echo");
+    failed = exhpool_submit(pool, task_throw, "task");
+    CHECK(echo != NULL && failed != NULL);
+    try{
+        CHECK(strcmp(exh_future_get(echo), "echo") == 0);
+        exh_future_get(failed);
+    }catch(IoError, e){
+        caught = 1;
+        CHECK(strcmp(e->data, "task") == 0);
+    }finally{}
+    CHECK(caught);
+    exhfuture_delete(echo);
+    exhfuture_delete(failed);
+
+    caught = 0;
+    try{
+        exh_parallel_for(pool, 0, 16, loop_throw, &calls);
+    }catch(AggregateError, e){
+        AggregateData *data = e->data;
+        caught = 1;
+        count = data->count;
+        for(int i=0; i < data->count; i++){
+            parsed += data->records[i]->class == ParseError;
+        }
+        exhaggregate_delete(data);
+    }finally{}
+    CHECK(caught && calls == 16 && count == 4 && parsed == 4);
+    exhpool_delete(pool);
+}
+
+static volatile int cancel_thread;
+
+// -----------------------------------------------------------------
+// cancel_target() :: thread waiting in a 'try' to be cancelled
+// -----------------------------------------------------------------
+static void* cancel_target(void *arg){
+    volatile int *caught = arg;
+
+    try{
+        cancel_thread = (int)pthread_self();
+        for(;;){
+            exh_cancel_point();
+            sched_yield();
+        }
+    }catch(IoError, e){
+        *caught = 1;
+    }finally{}
+
+    return NULL;
+}
+
+// -----------------------------------------------------------------
+// test_cancel() :: exhcancel() throws in the 'try' of another thread
+// at its next cancellation point
+// -----------------------------------------------------------------
+static void test_cancel(void){
+    volatile int caught = 0;
+    pthread_t thread;
+
+    if(pthread_create(&thread, NULL, cancel_target, (void*)&caught) != 0){
+        CHECK(!"pthread_create");
+        return;
+    }
+    while(cancel_thread == 0 || !exhcancel(cancel_thread, IoError, 0)){
+        sched_yield();
+    }
+    pthread_join(thread, NULL);
+    CHECK(caught);
+    exhthread_cleanup(cancel_thread);
+}
+#endif /* EXHANDLER_USE_PTHREAD */
+
+#ifdef EXHANDLER_DEADLINE
+// -----------------------------------------------------------------
+// test_deadline() :: TimeoutError cuts a 'try' short, a body done in
+// time is left alone
+// -----------------------------------------------------------------
+static void test_deadline(void){
+    volatile unsigned long spins = 0;
+    volatile int caught = 0;
+
+    try_deadline(2000000LL){
+        for(;;){ spins++; }
+    }catch(TimeoutError, e){
+        caught = 1;
+    }finally{}
+    CHECK(caught && spins > 0);
+
+    caught = 0;
+    try_deadline(1000000000LL){
+        spins = 0;
+    }catch(TimeoutError, e){
+        caught = 1;
+    }finally{}
+    CHECK(!caught && spins == 0);
+}
+#endif /* EXHANDLER_DEADLINE */
+
+#ifdef EXHANDLER_STATS
+// -----------------------------------------------------------------
+// test_stats() :: a snapshot counts the throws and catches since the
+// previous one, per class too; the classes are hashed into the table
+// -----------------------------------------------------------------
+static void test_stats(void){
+    static ExceptionStats before, after;
+    size_t throws = 0;
+
+    exhstats_snapshot(&before);
+    for(int i=0; i < 3; i++){
+        try{
+            throw_io(NULL);
+        }catch(IoError, e){
+        }finally{}
+    }
+    exhstats_snapshot(&after);
+    CHECK(after.throws == before.throws + 3);
+    CHECK(after.catches == before.catches + 3);
+    CHECK(after.lost == before.lost);
+    for(int i=0; i < EXH_STATS_CLASSES; i++){
+        if(after.classes[i].class == IoError){
+            throws += after.classes[i].throws;
+        }
+    }
+    for(int i=0; i < EXH_STATS_CLASSES; i++){
+        if(before.classes[i].class == IoError){
+            throws -= before.classes[i].throws;
+        }
+    }
+    CHECK(throws == 3);
+}
+#endif /* EXHANDLER_STATS */
+
+// -----------------------------------------------------------------
+// record_open() :: record the run in the files given to exhtest
+// -----------------------------------------------------------------
+static void record_open(int argc, char **argv){
+    (void)argc;
+    (void)argv;
+#ifdef EXHANDLER_EVENTS
+    if(argc > 1){
+        int fd = open(argv[1], O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        CHECK(fd >= 0 && exhevent_open(fd));
+    }
+#endif
+#ifdef EXHANDLER_FLIGHT_RECORDER
+    if(argc > 2){
+        CHECK(exhflight_open(argv[2], 8, 64));
+    }
+#endif
+}
+
+// -----------------------------------------------------------------
+// record_close() :: write the recorded events out, none dropped
+// -----------------------------------------------------------------
+static void record_close(int argc){
+    (void)argc;
+#ifdef EXHANDLER_EVENTS
+    if(argc > 1){
+        exhevent_close();
+        CHECK(exhevent_dropped() == 0);
+    }
+#endif
+#ifdef EXHANDLER_FLIGHT_RECORDER
+    if(argc > 2){
+        exhflight_close();
+    }
+#endif
+}
+
+int main(int argc, char **argv){
+    record_open(argc, argv);
+    test_throw();
+    test_nested();
+    test_nosig();
+    test_catch_any();
+    test_catch_if();
+    test_rethrow();
+#ifdef EXHANDLER_USE_PTHREAD
+    test_pool();
+    test_cancel();
+#endif
+#ifdef EXHANDLER_DEADLINE
+    test_deadline();
+#endif
+#ifdef EXHANDLER_STATS
+    test_stats();
+#endif
+    record_close(argc);
+    if(failures == 0){ printf("exhtest: all checks passed\n"); }
+
+    return failures;
+}
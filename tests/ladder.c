@@ -0,0 +1,32 @@
+#include "../src/exhandler.h"
+#include "ladder.h"
+
+/*
+ * ladder.c :: exhladder fixture, one superfluous catch and one duplicate
+ * catch_if; the catch after a catch_if of the same class is fine
+ */
+
+EXH_DEFINE(IoError, Exception);
+EXH_DEFINE(ParseError, Exception);
+
+static int is_fatal(void *data){
+    return data != NULL;
+}
+
+void ladder(void){
+    try{
+        throw(IoError, NULL);
+    }catch(Exception, e){
+    }catch(IoError, e){
+    }finally{}
+
+    try{
+        throw(IoError, "fatal");
+    }catch_if(IoError, e, is_fatal){
+    }catch(IoError, e){
+    }catch_if(IoError, e, is_fatal){
+    }finally{}
+
+    ladder_base();
+    ladder_derived();
+}
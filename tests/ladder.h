@@ -0,0 +1,21 @@
+/*
+ * ladder.h :: exhladder fixture, the clauses of a header included by two
+ * files, with no problem in either of them
+ */
+
+EXH_DECLARE(IoError, Exception);
+EXH_DECLARE(ParseError, Exception);
+
+static inline void ladder_base(void){
+    try{
+        throw(ParseError, NULL);
+    }catch(Exception, e){
+    }finally{}
+}
+
+static inline void ladder_derived(void){
+    try{
+        throw(IoError, NULL);
+    }catch(IoError, e){
+    }finally{}
+}
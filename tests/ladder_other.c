@@ -0,0 +1,21 @@
+#include "../src/exhandler.h"
+
+/*
+ * ladder_other.c :: exhladder fixture, a 'try' ahead of ladder.h gives
+ * the 'try's of the header other __COUNTER__ values here than in ladder.c
+ */
+
+static void ladder_first(void){
+    try{
+        throw(RuntimeError, NULL);
+    }catch(RuntimeError, e){
+    }finally{}
+}
+
+#include "ladder.h"
+
+void ladder_other(void){
+    ladder_first();
+    ladder_base();
+    ladder_derived();
+}
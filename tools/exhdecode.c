@@ -0,0 +1,154 @@
+#include<stdio.h>
+#include<stdlib.h>
+#include<string.h>
+#include "../src/exhandler.h"
+
+/*
+ * exhdecode :: print an exception event stream written by exhevent_open()
+ *
+ *      exhdecode [-j] [file]
+ *
+ * Reads standard input when no file is given. With -j each event is
+ * printed as one JSON object per line.
+ */
+
+static char **strings;
+static unsigned nstrings;
+
+// -----------------------------------------------------------------
+// get_string() :: name of a string id, empty when unknown
+// -----------------------------------------------------------------
+static const char* get_string(unsigned id){
+    if(id == 0 || id >= nstrings || strings[id] == NULL){ return ""; }
+    return strings[id];
+}
+
+// -----------------------------------------------------------------
+// set_string() :: record the name of a string id
+// -----------------------------------------------------------------
+static int set_string(unsigned id, char *name){
+    if(id >= nstrings){
+        unsigned size = nstrings ? nstrings : 256;
+        char **tmp;
+        while(size <= id){ size *= 2; }
+        if((tmp = realloc(strings, size * sizeof(char*))) == NULL){ return 0; }
+        memset(tmp + nstrings, 0, (size - nstrings) * sizeof(char*));
+        strings = tmp;
+        nstrings = size;
+    }
+    free(strings[id]);
+    strings[id] = name;
+
+    return 1;
+}
+
+// -----------------------------------------------------------------
+// print_json_string() :: print a string as a JSON literal
+// -----------------------------------------------------------------
+static void print_json_string(FILE *fp, const char *str){
+    fputc('"', fp);
+    for(; *str; str++){
+        if(*str == '"' || *str == '\\'){
+            fprintf(fp, "\\%c", *str);
+        }else if((unsigned char)*str < 0x20){
+            fprintf(fp, "\\u%04x", *str);
+        }else{
+            fputc(*str, fp);
+        }
+    }
+    fputc('"', fp);
+}
+
+// -----------------------------------------------------------------
+// print_event() :: print one event as text or JSON
+// -----------------------------------------------------------------
+static void print_event(FILE *fp, EventRecord *record, int json){
+    static const char *kinds[] = {"?", "throw", "catch", "lost", "assert"};
+    const char *kind = record->kind <= EXH_EVENT_ASSERT ?
+        kinds[record->kind] : kinds[0];
+
+    if(json){
+        fprintf(
+            fp, "{\"ts\":%llu,\"thread\":%d,\"kind\":\"%s\",\"class\":",
+            record->timestamp, record->thread, kind
+        );
+        print_json_string(fp, get_string(record->classid));
+        fprintf(fp, ",\"file\":");
+        print_json_string(fp, get_string(record->fileid));
+        fprintf(fp, ",\"line\":%d,\"depth\":%d", record->lineno, record->depth);
+        if(record->detailid){
+            fprintf(fp, ",\"detail\":");
+            print_json_string(fp, get_string(record->detailid));
+        }
+        fprintf(fp, "}\n");
+    }else{
+        fprintf(
+            fp, "%llu.%09llu %6d %-6s %-24s %s:%d depth=%d",
+            record->timestamp / 1000000000ULL,
+            record->timestamp % 1000000000ULL, record->thread, kind,
+            get_string(record->classid), get_string(record->fileid),
+            record->lineno, record->depth
+        );
+        if(record->detailid){
+            fprintf(fp, " %s", get_string(record->detailid));
+        }
+        fputc('\n', fp);
+    }
+}
+
+int main(int argc, char **argv){
+    FILE *fp = stdin;
+    char magic[8];
+    int json = 0;
+    int truncated = 1;
+    int type;
+
+    for(int i=1; i < argc; i++){
+        if(strcmp(argv[i], "-j") == 0){
+            json = 1;
+        }else if((fp = fopen(argv[i], "rb")) == NULL){
+            perror(argv[i]);
+            return 1;
+        }
+    }
+    if(fread(magic, sizeof(magic), 1, fp) != 1 ||
+        memcmp(magic, EXH_EVENT_MAGIC, sizeof(magic)) != 0){
+        fprintf(stderr, "exhdecode: not an exception event stream\n");
+        return 1;
+    }
+    while(1){
+        if((type = fgetc(fp)) == EOF){
+            truncated = 0;
+            break;
+        }else if(type == EXH_RECORD_STRING){
+            StringRecord record;
+            char *name;
+            record.type = type;
+            if(fread((char*)&record + 1, sizeof(record) - 1, 1, fp) != 1){
+                break;
+            }
+            if((name = malloc(record.len + 1)) == NULL){ return 1; }
+            if(fread(name, 1, record.len, fp) != record.len){
+                free(name);
+                break;
+            }
+            name[record.len] = '\0';
+            if(!set_string(record.id, name)){ return 1; }
+        }else if(type == EXH_RECORD_EVENT){
+            EventRecord record;
+            record.type = type;
+            if(fread((char*)&record + 1, sizeof(record) - 1, 1, fp) != 1){
+                break;
+            }
+            print_event(stdout, &record, json);
+        }else{
+            fprintf(stderr, "exhdecode: bad record type %d\n", type);
+            return 1;
+        }
+    }
+    if(truncated){
+        fprintf(stderr, "exhdecode: truncated stream\n");
+    }
+
+    return 0;
+}
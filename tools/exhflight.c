@@ -0,0 +1,127 @@
+#include<stdio.h>
+#include<stdlib.h>
+#include<string.h>
+#include "../src/exhandler.h"
+
+/*
+ * exhflight :: print the timeline kept in a flight recorder file
+ *
+ *      exhflight file
+ *
+ * The file is the one given to exhflight_open(), usually left behind by
+ * a process that died. Records of all threads are merged by time.
+ */
+
+typedef struct Entry{
+    int thread;
+    FlightRecord *record;
+} Entry;
+
+// -----------------------------------------------------------------
+// compare_entries() :: order records by timestamp, then sequence
+// -----------------------------------------------------------------
+static int compare_entries(const void *a, const void *b){
+    const FlightRecord *x = ((const Entry*)a)->record;
+    const FlightRecord *y = ((const Entry*)b)->record;
+    if(x->timestamp != y->timestamp){
+        return x->timestamp < y->timestamp ? -1 : 1;
+    }
+    if(x->seq != y->seq){ return x->seq < y->seq ? -1 : 1; }
+
+    return 0;
+}
+
+// -----------------------------------------------------------------
+// print_record() :: print one record with its 'try' trace
+// -----------------------------------------------------------------
+static void print_record(FILE *fp, Entry *entry, unsigned long long start){
+    static const char *kinds[] = {"?", "throw", "catch", "lost", "assert"};
+    FlightRecord *record = entry->record;
+    const char *kind = record->kind > 0 && record->kind <= EXH_EVENT_ASSERT ?
+        kinds[record->kind] : kinds[0];
+    long long delta = (long long)(record->timestamp - start);
+
+    fprintf(
+        fp, "%+14.6fms %6d %-6s %-24.32s %.48s:%d",
+        delta / 1e6, entry->thread, kind, record->class,
+        record->filename, record->lineno
+    );
+    if(record->signum){
+        fprintf(
+            fp, " signal %d at 0x%llx", record->signum, record->address
+        );
+    }
+    fputc('\n', fp);
+    for(int i=0; i < EXH_FLIGHT_TRIES && i < record->depth; i++){
+        fprintf(
+            fp, "%40s in 'try' at %.28s:%d\n", "",
+            record->tries[i].filename, record->tries[i].lineno
+        );
+    }
+    if(record->depth > EXH_FLIGHT_TRIES){
+        fprintf(
+            fp, "%40s ... %d more\n", "", record->depth - EXH_FLIGHT_TRIES
+        );
+    }
+}
+
+int main(int argc, char **argv){
+    FlightHeader header;
+    char *slots;
+    Entry *entries;
+    size_t slotsize, count = 0;
+    FILE *fp;
+
+    if(argc != 2){
+        fprintf(stderr, "usage: exhflight file\n");
+        return 1;
+    }
+    if((fp = fopen(argv[1], "rb")) == NULL){
+        perror(argv[1]);
+        return 1;
+    }
+    if(fread(&header, sizeof(header), 1, fp) != 1 ||
+        memcmp(header.magic, EXH_FLIGHT_MAGIC, sizeof(header.magic)) != 0 ||
+        header.recordsize != sizeof(FlightRecord)){
+        fprintf(stderr, "exhflight: not a flight recorder file\n");
+        return 1;
+    }
+    if(header.used > header.nthreads){ header.used = header.nthreads; }
+    slotsize = sizeof(FlightThread) + header.nevents * sizeof(FlightRecord);
+    slots = malloc(header.used * slotsize + 1);
+    entries = malloc(header.used * header.nevents * sizeof(Entry) + 1);
+    if(slots == NULL || entries == NULL){
+        fprintf(stderr, "exhflight: out of memory\n");
+        return 1;
+    }
+    if(fread(slots, slotsize, header.used, fp) != header.used){
+        fprintf(stderr, "exhflight: truncated file\n");
+        return 1;
+    }
+    fclose(fp);
+
+    for(unsigned i=0; i < header.used; i++){
+        FlightThread *slot = (FlightThread*)(slots + i * slotsize);
+        FlightRecord *records = (FlightRecord*)(slot + 1);
+        for(unsigned j=0; j < header.nevents; j++){
+            // a zero seq is a record torn by the crash, or never written
+            if(records[j].seq == 0){ continue; }
+            entries[count].thread = slot->thread;
+            entries[count].record = &records[j];
+            count++;
+        }
+    }
+    qsort(entries, count, sizeof(Entry), compare_entries);
+
+    printf(
+        "pid %d, %u of %u threads recorded, %zu records\n",
+        header.pid, header.used, header.nthreads, count
+    );
+    for(size_t i=0; i < count; i++){
+        print_record(stdout, &entries[i], header.starttime);
+    }
+    free(entries);
+    free(slots);
+
+    return 0;
+}
@@ -0,0 +1,362 @@
+#include<elf.h>
+#include<stdio.h>
+#include<stdlib.h>
+#include<string.h>
+#include "../src/exhandler.h"
+
+/*
+ * exhladder :: check the catch clauses of every 'try' without running it
+ *
+ *      exhladder file...
+ *
+ * The files are ELF objects, executables or libraries compiled with
+ * EXHANDLER_SITE_TABLE. It reports the duplicate and superfluous catch
+ * clauses DEBUG builds report at run time, catch_if() clauses included.
+ * It notes the 'try' without catch, a try/finally is fine, and the catch
+ * of a class no 'throw' of the same file can throw. A 'try' of a header
+ * is checked once, however many of the files include it. Exits with 2
+ * when it found any problem but the notes.
+ */
+
+typedef struct Class{
+    const char *name;
+    const char *parent;
+} Class;
+
+// the classes of exhandler.c, thrown by the runtime itself
+static const Class runtime[] = {
+    {"Throwable", ""},
+    {"Exception", "Throwable"},
+    {"OutOfMemoryError", "Exception"},
+    {"FailedAssertionError", "Exception"},
+    {"RuntimeError", "Exception"},
+    {"AbnormalTerminationError", "RuntimeError"},
+    {"ArithmethicError", "RuntimeError"},
+    {"IllegalInstructionError", "RuntimeError"},
+    {"SegmentationError", "RuntimeError"},
+    {"BusError", "RuntimeError"},
+    {"AggregateError", "Exception"},
+    {"TimeoutError", "Exception"},
+};
+
+static SiteRecord *records;
+static size_t nrecords;
+static size_t nalloc;
+
+// -----------------------------------------------------------------
+// add_record() :: append a record
+// -----------------------------------------------------------------
+static int add_record(SiteRecord *record){
+    if(nrecords == nalloc){
+        size_t size = nalloc ? nalloc * 2 : 256;
+        SiteRecord *tmp = realloc(records, size * sizeof(SiteRecord));
+        if(tmp == NULL){ return 0; }
+        records = tmp;
+        nalloc = size;
+    }
+    records[nrecords++] = *record;
+
+    return 1;
+}
+
+// -----------------------------------------------------------------
+// load_file() :: append the site records of an ELF file
+// -----------------------------------------------------------------
+static int load_file(const char *path){
+    Elf64_Ehdr *header;
+    Elf64_Shdr *sections;
+    const char *names;
+    char *image;
+    long size;
+    FILE *fp;
+
+    if((fp = fopen(path, "rb")) == NULL){
+        perror(path);
+        return 0;
+    }
+    fseek(fp, 0, SEEK_END);
+    size = ftell(fp);
+    rewind(fp);
+    if(size < (long)sizeof(Elf64_Ehdr) || (image = malloc(size)) == NULL ||
+        fread(image, 1, size, fp) != (size_t)size){
+        fprintf(stderr, "exhladder: cannot read %s\n", path);
+        fclose(fp);
+        return 0;
+    }
+    fclose(fp);
+    header = (Elf64_Ehdr*)image;
+    if(memcmp(header->e_ident, ELFMAG, SELFMAG) != 0 ||
+        header->e_ident[EI_CLASS] != ELFCLASS64 ||
+        header->e_shoff + header->e_shnum * sizeof(Elf64_Shdr) > (size_t)size ||
+        header->e_shstrndx >= header->e_shnum){
+        fprintf(stderr, "exhladder: %s: not a 64-bit ELF file\n", path);
+        free(image);
+        return 0;
+    }
+    sections = (Elf64_Shdr*)(image + header->e_shoff);
+    names = image + sections[header->e_shstrndx].sh_offset;
+    for(int i=0; i < header->e_shnum; i++){
+        Elf64_Shdr *section = &sections[i];
+        size_t count = section->sh_size / sizeof(SiteRecord);
+        if(section->sh_type == SHT_NOBITS ||
+            strcmp(names + section->sh_name, EXH_SITE_SECTION) != 0 ||
+            section->sh_offset + section->sh_size > (size_t)size){
+            continue;
+        }
+        for(size_t j=0; j < count; j++){
+            SiteRecord record;
+            memcpy(
+                &record, image + section->sh_offset + j * sizeof(record),
+                sizeof(record)
+            );
+            // padding between the records of two objects reads as zeros
+            if(record.kind < EXH_SITE_TRY || record.kind > EXH_SITE_CATCH_IF){
+                continue;
+            }
+            record.class[sizeof(record.class) - 1] = '\0';
+            record.parent[sizeof(record.parent) - 1] = '\0';
+            record.filename[sizeof(record.filename) - 1] = '\0';
+            if(!add_record(&record)){
+                free(image);
+                return 0;
+            }
+        }
+    }
+    free(image);
+
+    return 1;
+}
+
+// -----------------------------------------------------------------
+// get_parent() :: parent class name, NULL when the class is unknown
+// -----------------------------------------------------------------
+static const char* get_parent(const char *name){
+    for(size_t i=0; i < nrecords; i++){
+        if(records[i].kind == EXH_SITE_CLASS &&
+            strcmp(records[i].class, name) == 0){
+            return records[i].parent;
+        }
+    }
+    for(size_t i=0; i < sizeof(runtime) / sizeof(runtime[0]); i++){
+        if(strcmp(runtime[i].name, name) == 0){ return runtime[i].parent; }
+    }
+
+    return NULL;
+}
+
+// -----------------------------------------------------------------
+// is_runtime() :: class declared by exhandler.h
+// -----------------------------------------------------------------
+static int is_runtime(const char *name){
+    for(size_t i=0; i < sizeof(runtime) / sizeof(runtime[0]); i++){
+        if(strcmp(runtime[i].name, name) == 0){ return 1; }
+    }
+
+    return 0;
+}
+
+// -----------------------------------------------------------------
+// is_derived() :: 'name' is 'base' or one of its descendants
+// -----------------------------------------------------------------
+static int is_derived(const char *name, const char *base){
+    // the depth bounds a hierarchy made circular by a bad EXH_DEFINE
+    for(int depth=0; name != NULL && *name && depth < 64; depth++){
+        if(strcmp(name, base) == 0){ return 1; }
+        name = get_parent(name);
+    }
+
+    return 0;
+}
+
+// -----------------------------------------------------------------
+// is_thrown() :: whether a 'throw' of 'filename' may throw 'class'
+// -----------------------------------------------------------------
+static int is_thrown(const char *filename, const char *class){
+    for(size_t i=0; i < nrecords; i++){
+        SiteRecord *record = &records[i];
+        if(record->kind != EXH_SITE_THROW ||
+            strcmp(record->filename, filename) != 0){
+            continue;
+        }
+        // an expression, not a class name: it may throw anything
+        if(get_parent(record->class) == NULL ||
+            is_derived(record->class, class)){
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+// -----------------------------------------------------------------
+// compare_sites() :: order by file and 'try', the 'try' before its
+// catch clauses and the clauses as written
+// -----------------------------------------------------------------
+static int compare_sites(const void *a, const void *b){
+    const SiteRecord *x = a;
+    const SiteRecord *y = b;
+    int diff = strcmp(x->filename, y->filename);
+    if(diff != 0){ return diff; }
+    if(x->site != y->site){ return x->site < y->site ? -1 : 1; }
+    if(x->ordinal != y->ordinal){ return x->ordinal < y->ordinal ? -1 : 1; }
+    if((x->kind == EXH_SITE_TRY) != (y->kind == EXH_SITE_TRY)){
+        return x->kind == EXH_SITE_TRY ? -1 : 1;
+    }
+    if(x->lineno != y->lineno){ return x->lineno < y->lineno ? -1 : 1; }
+    if(x->order != y->order){ return x->order < y->order ? -1 : 1; }
+    if(x->index != y->index){ return x->index < y->index ? -1 : 1; }
+
+    return strcmp(x->class, y->class);
+}
+
+// -----------------------------------------------------------------
+// ladder_length() :: records of the 'try' at 'i' and its clauses,
+// 0 when 'i' is no 'try'
+// -----------------------------------------------------------------
+static size_t ladder_length(SiteRecord *sites, size_t nsites, size_t i){
+    size_t j = i + 1;
+
+    if(sites[i].kind != EXH_SITE_TRY){ return 0; }
+    while(j < nsites && sites[j].kind != EXH_SITE_TRY &&
+        sites[j].site == sites[i].site &&
+        sites[j].ordinal == sites[i].ordinal &&
+        strcmp(sites[j].filename, sites[i].filename) == 0){
+        j++;
+    }
+
+    return j - i;
+}
+
+// -----------------------------------------------------------------
+// same_ladder() :: two 'try's with the same clauses, the __COUNTER__
+// values aside
+// -----------------------------------------------------------------
+static int same_ladder(SiteRecord *x, SiteRecord *y, size_t n){
+    for(size_t i=0; i < n; i++){
+        SiteRecord a = x[i], b = y[i];
+        a.ordinal = b.ordinal = a.order = b.order = 0;
+        if(compare_sites(&a, &b) != 0){ return 0; }
+    }
+
+    return 1;
+}
+
+// -----------------------------------------------------------------
+// check_ladder() :: check the catch clauses of one 'try'
+// -----------------------------------------------------------------
+static int check_ladder(SiteRecord *site, SiteRecord *clauses, size_t n){
+    int problems = 0;
+
+    if(n == 0){
+        printf(
+            "Note: No catch clause(s): file \"%s\", line %d.\n",
+            site->filename, site->lineno
+        );
+        return 0;
+    }
+    for(size_t i=0; i < n; i++){
+        SiteRecord *check = &clauses[i];
+        const char *clause = check->kind == EXH_SITE_CATCH_IF ?
+            "catch_if" : "catch";
+        for(size_t j=0; j < i; j++){
+            SiteRecord *prior = &clauses[j];
+            // a catch_if() may decline, the clauses below stay reachable
+            if(prior->kind == EXH_SITE_CATCH_IF){ continue; }
+            if(strcmp(check->class, prior->class) == 0){
+                printf(
+                    "Duplicate %s(%s): file \"%s\", line %d; "
+                    "already caught at line %d.\n",
+                    clause, check->class, check->filename, check->lineno,
+                    prior->lineno
+                );
+                problems++;
+                break;
+            }
+            if(is_derived(check->class, prior->class)){
+                printf(
+                    "Superfluous %s(%s): file \"%s\", line %d; "
+                    "already caught by %s at line %d.\n",
+                    clause, check->class, check->filename, check->lineno,
+                    prior->class, prior->lineno
+                );
+                problems++;
+                break;
+            }
+        }
+        if(get_parent(check->class) != NULL && !is_runtime(check->class) &&
+            !is_thrown(check->filename, check->class)){
+            printf(
+                "Note: %s(%s): file \"%s\", line %d; no 'throw' of "
+                "this file throws it.\n",
+                clause, check->class, check->filename, check->lineno
+            );
+        }
+    }
+
+    return problems;
+}
+
+int main(int argc, char **argv){
+    SiteRecord *sites;
+    size_t nsites = 0, nclauses = 0, kept = 0;
+    int problems = 0;
+
+    if(argc < 2){
+        fprintf(stderr, "usage: exhladder file...\n");
+        return 1;
+    }
+    for(int i=1; i < argc; i++){
+        if(!load_file(argv[i])){ return 1; }
+    }
+    if((sites = malloc((nrecords + 1) * sizeof(SiteRecord))) == NULL){
+        return 1;
+    }
+    for(size_t i=0; i < nrecords; i++){
+        if(records[i].kind == EXH_SITE_TRY ||
+            records[i].kind == EXH_SITE_CATCH ||
+            records[i].kind == EXH_SITE_CATCH_IF){
+            sites[nsites++] = records[i];
+        }
+    }
+    qsort(sites, nsites, sizeof(SiteRecord), compare_sites);
+    // an object linked into two of the files leaves its records twice
+    for(size_t i=0; i < nsites; i++){
+        if(kept == 0 || compare_sites(&sites[i], &sites[kept - 1]) != 0){
+            sites[kept++] = sites[i];
+        }
+    }
+    nsites = kept;
+    for(size_t i=0, line=0; i < nsites; ){
+        size_t n = ladder_length(sites, nsites, i);
+        int seen = 0;
+        if(n == 0){
+            // the 'try' of the clause was dropped by the linker
+            i++;
+            continue;
+        }
+        // a 'try' of a header is met once per file including it, with
+        // another ordinal each time: check its clauses once
+        if(sites[line].site != sites[i].site ||
+            strcmp(sites[line].filename, sites[i].filename) != 0){
+            line = i;
+        }
+        for(size_t k=line; k < i && !seen; ){
+            size_t m = ladder_length(sites, nsites, k);
+            seen = m == n && same_ladder(&sites[k], &sites[i], n);
+            k += m ? m : 1;
+        }
+        if(!seen){
+            problems += check_ladder(&sites[i], &sites[i + 1], n - 1);
+            nclauses += n - 1;
+        }
+        i += n;
+    }
+    fprintf(
+        stderr, "exhladder: %zu catch clause(s) checked, %d problem(s)\n",
+        nclauses, problems
+    );
+    free(sites);
+    free(records);
+
+    return problems ? 2 : 0;
+}